@@ -1,6 +1,55 @@
 #include "plugin.hpp"
 #include "common.hpp"
 
+// Four xoshiro128+ generators side by side, one per lane, so a single step gives a float_4 of draws.
+// each instance has its own, so modules never share or fight over generator state
+struct ChanceRandom
+{
+	uint32_t s[4][4];
+
+	static uint32_t rotl(const uint32_t x, const int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+
+	// fills the state from seed with splitmix64, which never leaves a lane all zero
+	void seed(const uint32_t seed)
+	{
+		uint64_t x = seed;
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+				s[i][lane] = static_cast<uint32_t>((z ^ (z >> 31)) >> 32);
+			}
+		}
+	}
+
+	// uniform in [0, 1) for each lane, from the top 24 bits since the low bits of xoshiro128+ are weak
+	simd::float_4 uniform()
+	{
+		float out[4];
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			const uint32_t result = s[0][lane] + s[3][lane];
+			const uint32_t t = s[1][lane] << 9;
+
+			s[2][lane] ^= s[0][lane];
+			s[3][lane] ^= s[1][lane];
+			s[1][lane] ^= s[2][lane];
+			s[0][lane] ^= s[3][lane];
+			s[2][lane] ^= t;
+			s[3][lane] = rotl(s[3][lane], 11);
+
+			out[lane] = (result >> 8) * (1.f / 16777216.f);
+		}
+		return simd::float_4::load(out);
+	}
+};
+
 struct Chance : Module
 {
 	enum ParamIds
@@ -37,8 +86,29 @@ struct Chance : Module
 		NUM_LIGHTS
 	};
 
-	int open[4] = {0};
-	dsp::SchmittTrigger trigger;
+	// open[i][g] is a mask of which channels in group g (channels 4g to 4g+3) output i is letting through.
+	// every gate channel has its own trigger and its own draw per output
+	simd::float_4 open[4][4] = {};
+	dsp::TSchmittTrigger<simd::float_4> triggers[4];
+
+	// between triggers the outputs only change when the gate does, so each group keeps the gate voltages it
+	// last saw and is skipped while they stay the same. NAN never compares equal, so it forces an update
+	simd::float_4 last_gate[4] = {NAN, NAN, NAN, NAN};
+	int last_channels = 0;
+
+	// the lights fade towards light_targets every light_divider samples, the targets only change on triggers
+	float light_targets[4] = {};
+	dsp::ClockDivider light_divider;
+
+	// the seed is saved with the patch. in deterministic mode the generator starts again from it whenever
+	// the patch is loaded, so rendering the same patch gives the same gates every time.
+	// rng is only ever touched by the audio thread. the ui asks for a new seed with new_seed, or for the
+	// generator to start again from seed with reseed, and the audio thread picks both up before the next draw
+	ChanceRandom rng;
+	std::atomic<uint32_t> seed{0};
+	bool deterministic = false;
+	std::atomic<bool> new_seed{false};
+	std::atomic<bool> reseed{false};
 
 	Chance()
 	{
@@ -47,31 +117,119 @@ struct Chance : Module
 		configParam(TWO_PARAM, 0.f, 1.f, 0.5f, "Chance for output 2");
 		configParam(THREE_PARAM, 0.f, 1.f, 0.5f, "Chance for output 3");
 		configParam(FOUR_PARAM, 0.f, 1.f, 0.5f, "Chance for output 4");
+
+		seed.store(random::u32());
+		rng.seed(seed.load());
+
+		light_divider.setDivision(256);
+	}
+
+	json_t *dataToJson() override
+	{
+		json_t *root_json = json_object();
+
+		json_object_set_new(root_json, "seed", json_integer(seed.load()));
+		json_object_set_new(root_json, "deterministic", json_boolean(deterministic));
+
+		return root_json;
+	}
+
+	void dataFromJson(json_t *root_json) override
+	{
+		json_t *temp_json = json_object_get(root_json, "seed");
+		if (temp_json)
+			seed.store(static_cast<uint32_t>(json_integer_value(temp_json)));
+
+		temp_json = json_object_get(root_json, "deterministic");
+		if (temp_json)
+			deterministic = json_boolean_value(temp_json);
+
+		if (deterministic)
+			reseed.store(true);
+	}
+
+	void onReset() override
+	{
+		if (deterministic)
+			reseed.store(true);
 	}
 
 	void process(const ProcessArgs &args) override
 	{
+		// plain loads first, so the common case doesn't pay for an exchange every sample
+		if (new_seed.load(std::memory_order_relaxed) && new_seed.exchange(false))
+		{
+			seed.store(random::u32());
+			reseed.store(true);
+		}
+		if (reseed.load(std::memory_order_relaxed) && reseed.exchange(false))
+			rng.seed(seed.load());
+
 		if (!inputs[GATE_INPUT].isConnected())
 			return;
 
-		const float v = inputs[GATE_INPUT].getVoltage();
-
-		if (trigger.process(rescale(v, 0.1f, 2.0f, 0.0f, 1.0f)))
+		if (light_divider.process())
 		{
 			for (int i = 0; i < 4; ++i)
+				lights[i].setSmoothBrightness(light_targets[i], args.sampleTime * light_divider.getDivision());
+		}
+
+		// an output that's been unplugged and plugged back in comes back with 1 channel, so the count is checked
+		// on every sample rather than only when the gate's changes. either way every group is written again
+		const int channels = inputs[GATE_INPUT].getChannels();
+		bool reshaped = channels != last_channels;
+		for (int i = 0; i < 4; ++i)
+		{
+			if (outputs[i].isConnected() && outputs[i].getChannels() != channels)
 			{
-				open[i] = random::uniform() < params[i].getValue() * abs(inputs[i + 1].getNormalVoltage(10.0f)) / 10.0f ? 1 : 0;
-				if (open[i] == 1)
-					lights[i].setSmoothBrightness(1.0, 0.1);
-				else
-					lights[i].setSmoothBrightness(0.0, 0.1);
+				outputs[i].setChannels(channels);
+				reshaped = true;
 			}
 		}
+		if (reshaped)
+		{
+			last_channels = channels;
+			for (int g = 0; g < 4; ++g)
+				last_gate[g] = NAN;
+		}
 
-		for (int i = 0; i < 4; ++i)
+		bool triggered = false;
+		for (int c = 0; c < channels; c += 4)
 		{
-			if (outputs[i].isConnected())
-				outputs[i].setVoltage(v * open[i]);
+			const int g = c / 4;
+			const simd::float_4 v = inputs[GATE_INPUT].getVoltageSimd<simd::float_4>(c);
+			if (!simd::movemask(v != last_gate[g]))
+				continue;
+			last_gate[g] = v;
+
+			// the trigger and the chance cvs only matter when the gate moves
+			const simd::float_4 trigger = triggers[g].process((v - 0.1f) * (1.f / 1.9f));
+
+			// a draw per output for every channel in the group, only the channels that triggered keep theirs
+			if (simd::movemask(trigger))
+			{
+				triggered = true;
+				for (int i = 0; i < 4; ++i)
+				{
+					const simd::float_4 chance = params[i].getValue() * simd::abs(inputs[i + 1].getNormalPolyVoltageSimd<simd::float_4>(10.f, c)) / 10.f;
+					open[i][g] = simd::ifelse(trigger, rng.uniform() < chance, open[i][g]);
+				}
+			}
+
+			for (int i = 0; i < 4; ++i)
+				outputs[i].setVoltageSimd(simd::ifelse(open[i][g], v, 0.f), c);
+		}
+
+		// the lights show how many of the channels each output is letting through
+		if (triggered)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				int count = 0;
+				for (int c = 0; c < channels; ++c)
+					count += (simd::movemask(open[i][c / 4]) >> (c % 4)) & 1;
+				light_targets[i] = static_cast<float>(count) / channels;
+			}
 		}
 	}
 };
@@ -104,6 +262,42 @@ struct ChanceWidget : ModuleWidget
 		addChild(createLightCentered<MediumLight<PinkLight>>(mm2px(Vec(32.485, 20.078)), module, Chance::THREE_LIGHT));
 		addChild(createLightCentered<MediumLight<PinkLight>>(mm2px(Vec(37.565, 20.078)), module, Chance::FOUR_LIGHT));
 	}
+
+	struct DeterministicItem : MenuItem
+	{
+		Chance *module;
+
+		void onAction(const event::Action &e) override
+		{
+			module->deterministic = !module->deterministic;
+		}
+	};
+
+	struct NewSeedItem : MenuItem
+	{
+		Chance *module;
+
+		void onAction(const event::Action &e) override
+		{
+			module->new_seed.store(true);
+		}
+	};
+
+	void appendContextMenu(Menu *menu) override
+	{
+		Chance *module = dynamic_cast<Chance *>(this->module);
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel(string::f("Seed: %08x", module->seed.load())));
+
+		DeterministicItem *deterministic_item = createMenuItem<DeterministicItem>("Deterministic", CHECKMARK(module->deterministic));
+		deterministic_item->module = module;
+		menu->addChild(deterministic_item);
+
+		NewSeedItem *new_seed_item = createMenuItem<NewSeedItem>("New seed");
+		new_seed_item->module = module;
+		menu->addChild(new_seed_item);
+	}
 };
 
 Model *modelChance = createModel<Chance, ChanceWidget>("chance");
\ No newline at end of file
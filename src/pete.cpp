@@ -1,5 +1,314 @@
 #include "plugin.hpp"
 #include "common.hpp"
+#include <thread>
+
+static const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string encodeBase64(const uint8_t *data, size_t len)
+{
+	std::string out;
+	out.reserve((len + 2) / 3 * 4);
+	for (size_t i = 0; i < len; i += 3)
+	{
+		const uint32_t n = (data[i] << 16) | (i + 1 < len ? data[i + 1] << 8 : 0) | (i + 2 < len ? data[i + 2] : 0);
+		out += BASE64_CHARS[(n >> 18) & 63];
+		out += BASE64_CHARS[(n >> 12) & 63];
+		out += i + 1 < len ? BASE64_CHARS[(n >> 6) & 63] : '=';
+		out += i + 2 < len ? BASE64_CHARS[n & 63] : '=';
+	}
+	return out;
+}
+
+static std::vector<uint8_t> decodeBase64(const char *str, size_t len)
+{
+	int lookup[256];
+	std::fill(lookup, lookup + 256, -1);
+	for (int i = 0; i < 64; ++i)
+		lookup[(uint8_t)BASE64_CHARS[i]] = i;
+
+	std::vector<uint8_t> out;
+	out.reserve(len / 4 * 3);
+	uint32_t n = 0;
+	int bits = 0;
+	for (size_t i = 0; i < len; ++i)
+	{
+		const int v = lookup[(uint8_t)str[i]];
+		if (v < 0)
+			continue;
+		n = (n << 6) | v;
+		bits += 6;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			out.push_back((n >> bits) & 0xff);
+		}
+	}
+	return out;
+}
+
+// Capture memory shared by every Pete. Buffers are built out of fixed size blocks,
+// and blocks handed back when a Pete is removed or its buffers shrink are kept on
+// a free list for the next one, so adding modules doesn't go back to the heap.
+// only ever used while allocating buffers, never from the per-sample path
+struct PeteBlockPool
+{
+	// each block has room to be aligned to 64 bytes and a little slack past the end
+	static const size_t BLOCK_BYTES = 1 << 20;
+	static const size_t BLOCK_PADDING = 128;
+	// blocks given back past this many free ones go back to the system, so memory freed by
+	// shrinking or deleting a Pete isn't held for the rest of the session
+	static const size_t MAX_FREE_BLOCKS = 64;
+
+	std::mutex mutex;
+	std::vector<uint8_t *> free_blocks;
+	size_t total_blocks = 0;
+
+	~PeteBlockPool()
+	{
+		for (auto block : free_blocks)
+			delete[] block;
+	}
+
+	uint8_t *acquire()
+	{
+		uint8_t *block;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (free_blocks.empty())
+			{
+				block = new uint8_t[BLOCK_BYTES + BLOCK_PADDING];
+				++total_blocks;
+			}
+			else
+			{
+				block = free_blocks.back();
+				free_blocks.pop_back();
+			}
+		}
+		std::memset(block, 0, BLOCK_BYTES + BLOCK_PADDING);
+		return block;
+	}
+
+	void release(uint8_t *block)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (free_blocks.size() < MAX_FREE_BLOCKS)
+			{
+				free_blocks.push_back(block);
+				return;
+			}
+			--total_blocks;
+		}
+		delete[] block;
+	}
+
+	size_t totalBytes()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return total_blocks * BLOCK_BYTES;
+	}
+
+	size_t freeBytes()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return free_blocks.size() * BLOCK_BYTES;
+	}
+};
+
+static PeteBlockPool pete_pool;
+
+// Interleaved capture buffer holding one frame of `stride` samples per sample period.
+// stride is the channel count rounded up to a power of two, so with each block
+// aligned to 64 bytes a frame never straddles a cache line or a block, and frames of
+// 4 or more channels can be moved with whole float_4 loads and stores.
+// samples are either kept as floats or as int16 over +-12v, which halves the memory.
+// blocks have some slack past the end, so narrower frames can still be read
+// with a 4 wide load and the extra lanes ignored
+struct PeteBuffer
+{
+	enum Format
+	{
+		FORMAT_FLOAT,
+		FORMAT_INT16,
+		NUM_FORMATS
+	};
+
+	std::vector<uint8_t *> blocks, block_data;
+	size_t bytes = 0;
+	int format = FORMAT_FLOAT;
+	int channels = 1;
+	int stride = 1;
+	int frames = 0;
+
+	// frame i lives in block i >> block_shift, (i & block_mask) << frame_shift bytes in
+	int block_shift = 0;
+	int block_mask = 0;
+	int frame_shift = 0;
+
+	static constexpr float INT16_SCALE = 32767.f / 12.f;
+
+	static int sampleSize(int format)
+	{
+		return format == FORMAT_INT16 ? sizeof(int16_t) : sizeof(float);
+	}
+
+	// grows or shrinks to n bytes rounded up to whole blocks, trading blocks with the pool
+	void allocate(size_t n, int f)
+	{
+		const size_t num_blocks = std::max((n + PeteBlockPool::BLOCK_BYTES - 1) / PeteBlockPool::BLOCK_BYTES, (size_t)1);
+		while (blocks.size() > num_blocks)
+		{
+			pete_pool.release(blocks.back());
+			blocks.pop_back();
+		}
+		while (blocks.size() < num_blocks)
+			blocks.push_back(pete_pool.acquire());
+
+		block_data.resize(blocks.size());
+		for (size_t i = 0; i < blocks.size(); ++i)
+			block_data[i] = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(blocks[i]) + 63) & ~static_cast<uintptr_t>(63));
+
+		bytes = num_blocks * PeteBlockPool::BLOCK_BYTES;
+		format = f;
+		setChannels(channels);
+	}
+
+	void release()
+	{
+		for (auto block : blocks)
+			pete_pool.release(block);
+		blocks.clear();
+		block_data.clear();
+		bytes = 0;
+		frames = 0;
+	}
+
+	void setChannels(int c)
+	{
+		channels = c;
+		stride = 1;
+		while (stride < c)
+			stride <<= 1;
+
+		frame_shift = 0;
+		while ((1 << frame_shift) < stride * sampleSize(format))
+			++frame_shift;
+		block_shift = 0;
+		while (((size_t)1 << (block_shift + frame_shift)) < PeteBlockPool::BLOCK_BYTES)
+			++block_shift;
+		block_mask = (1 << block_shift) - 1;
+		frames = blocks.size() << block_shift;
+	}
+
+	uint8_t *frameBytes(int i)
+	{
+		return block_data[i >> block_shift] + ((i & block_mask) << frame_shift);
+	}
+
+	// channels c to c + 3 of frame i
+	simd::float_4 load(int i, int c)
+	{
+		if (format == FORMAT_INT16)
+		{
+			const int16_t *p = reinterpret_cast<int16_t *>(frameBytes(i)) + c;
+			return simd::float_4(p[0], p[1], p[2], p[3]) * (1.f / INT16_SCALE);
+		}
+		return simd::float_4::load(reinterpret_cast<float *>(frameBytes(i)) + c);
+	}
+
+	// mixes one voltage per channel into frame i, in must hold at least stride values
+	void overdub(int i, const float *in)
+	{
+		float frame[16];
+		for (int c = 0; c < stride; c += 4)
+			(load(i, c) + simd::float_4::load(in + c)).store(frame + c);
+		store(i, frame);
+	}
+
+	// writes frame i from one voltage per channel, in must hold at least stride values
+	void store(int i, const float *in)
+	{
+		if (format == FORMAT_INT16)
+		{
+			int16_t *p = reinterpret_cast<int16_t *>(frameBytes(i));
+			for (int c = 0; c < stride; ++c)
+				p[c] = static_cast<int16_t>(clamp(in[c], -12.f, 12.f) * INT16_SCALE);
+			return;
+		}
+
+		float *p = reinterpret_cast<float *>(frameBytes(i));
+		if (stride >= 4)
+		{
+			for (int c = 0; c < stride; c += 4)
+				simd::float_4::load(in + c).store(p + c);
+		}
+		else
+		{
+			for (int c = 0; c < stride; ++c)
+				p[c] = in[c];
+		}
+	}
+};
+
+// A captured loop of size frames. capturing pins the window of the recorder starting at start,
+// which then gets copied into the slot's own buffer a slice per sample. frames below copied
+// are read from the slot's buffer, the rest still from the recorder.
+// copied is written by the audio thread and read by the serializer
+struct PeteSlot
+{
+	int start = 0;
+	int size = 0;
+	std::atomic<int> copied{0};
+};
+
+static const int PETE_MAX_SLOTS = 8;
+
+// Everything a Pete records into and plays from, buffers[0] is the recorder and slot s owns buffers[s + 1].
+// every Pete has two of these, the audio thread runs on one while rebuilds happen in the other
+struct PeteBank
+{
+	PeteBuffer buffers[PETE_MAX_SLOTS + 1];
+	PeteSlot slots[PETE_MAX_SLOTS];
+	int num_slots = 0;
+
+	// the recorder and n slots get a buffer of the given size each, the rest go back to the pool, and every slot is emptied
+	void allocate(size_t bytes, int format, int n)
+	{
+		num_slots = n;
+		buffers[0].allocate(bytes, format);
+		for (int s = 0; s < PETE_MAX_SLOTS; ++s)
+		{
+			if (s < num_slots)
+				buffers[s + 1].allocate(bytes, format);
+			else
+				buffers[s + 1].release();
+			slots[s].start = 0;
+			slots[s].size = 0;
+			slots[s].copied.store(0);
+		}
+	}
+
+	void release()
+	{
+		for (int i = 0; i <= PETE_MAX_SLOTS; ++i)
+			buffers[i].release();
+		for (int s = 0; s < PETE_MAX_SLOTS; ++s)
+		{
+			slots[s].size = 0;
+			slots[s].copied.store(0);
+		}
+		num_slots = 0;
+	}
+
+	size_t allocatedBytes()
+	{
+		size_t bytes = 0;
+		for (int i = 0; i <= PETE_MAX_SLOTS; ++i)
+			bytes += buffers[i].bytes;
+		return bytes;
+	}
+};
 
 struct Pete : Module
 {
@@ -20,6 +329,9 @@ struct Pete : Module
 		DIV_INPUT,
 		SPEED_INPUT,
 		MUL_INPUT,
+		SLOT_INPUT,
+		CAPTURE_INPUT,
+		OVERDUB_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds
@@ -31,14 +343,86 @@ struct Pete : Module
 	{
 		NUM_LIGHTS
 	};
+	enum Interpolation
+	{
+		INTERPOLATION_NEAREST,
+		INTERPOLATION_LINEAR,
+		INTERPOLATION_HERMITE,
+		NUM_INTERPOLATIONS
+	};
 
+	enum RebuildState
+	{
+		REBUILD_IDLE,
+		REBUILD_READY,
+		REBUILD_SWAPPING,
+		REBUILD_SWAPPED
+	};
+
+	// frames copied out of the recorder per sample for every capture still in progress
+	static const int COPY_SLICE = 64;
+	// the most frames overdub fills in between two samples, past that the read head has jumped rather than moved
+	static const int OVERDUB_MAX_STEP = 16;
+
+	// bank->buffers[0] is the recorder, a ring buffer sized for the longest possible mono loop (4 beats at 1 bpm),
+	// data_size is just the window of it that the current bpm looks back over.
+	// polyphonic input shares the same memory, so more channels means a shorter maximum loop.
+	// slot s owns bank->buffers[s + 1], of the same size. capturing pins the last data_size frames of
+	// the recorder, which keeps recording without gaps, and the copy into the slot's buffer is
+	// spread over the following samples. the copy starts at the oldest frame and moves faster
+	// than the write head, so nothing is overwritten before it has been copied
 	int data_size = 0;
 	int write_pos = 0;
+	// frames recorded since the recorder last started over, switching on only freezes once there's a whole loop of them
+	int recorded = 0;
 	float read_pos = 0;
-	std::vector<float> record_data, playback_data;
 	bool active = false;
+	// the last loop frame overdub wrote to, -1 when it isn't overdubbing
+	int overdub_frame = -1;
+	int interpolation = INTERPOLATION_LINEAR;
+
+	// play is the slot being played, owned by the audio thread and published through playing_slot.
+	// the ui recalls a slot by storing it in requested_slot, which gets picked up at control rate.
+	// generation is odd while a slot is being captured or the buffers rebuilt, so the serializer
+	// can tell its copy was torn and try again rather than making the engine wait
+	int play = 0;
+	int base_slot = 0;
+	int selected_slot = 0;
+	std::atomic<int> playing_slot{0};
+	std::atomic<int> requested_slot{-1};
+	std::atomic<uint32_t> generation{0};
+
+	// bank is banks[live_bank], the one the audio thread runs on. the ui owns the settings below, memory_cap is
+	// in MB across all buffers (0 for no cap). changing them, or the sample rate, sets reallocate, and the widget
+	// then builds the other bank off the audio thread and marks it ready. the audio thread swaps it in between
+	// two samples by flipping live_bank, and the ui gives the old buffers back to the pool afterwards.
+	// rebuild_state goes idle -> ready -> swapping -> swapped -> idle
+	PeteBank banks[2];
+	PeteBank *bank = &banks[0];
+	std::atomic<int> live_bank{0};
+	std::atomic<int> rebuild_state{REBUILD_IDLE};
+	std::atomic<bool> reallocate{false};
+	// a patch or preset load builds the spare bank with its loops in, and leaves where to carry on
+	// playing from here for the audio thread to pick up when it swaps the bank in
+	struct PendingLoad
+	{
+		bool loaded = false;
+		int play = 0;
+		int base_slot = 0;
+		float read_pos = 0.f;
+	} pending;
+	int storage_format = PeteBuffer::FORMAT_FLOAT;
+	int memory_cap = 16;
+	int num_slots = 1;
 
-	dsp::SchmittTrigger on_trigger;
+	// tempo, division, speed, gain and slot only get read every control_divider samples,
+	// speed and gain then ramp linearly towards their new values over the next block
+	dsp::ClockDivider control_divider;
+	int div_shift = 0;
+	float speed = 1.f, speed_step = 0.f;
+	float gain = 1.f, gain_step = 0.f;
+
+	dsp::SchmittTrigger on_trigger, capture_trigger;
 
 	Pete()
 	{
@@ -48,6 +432,331 @@ struct Pete : Module
 		configParam(DIV_PARAM, 0.f, 8.f, 0.f, "Number to divide the previous 4 beats by");
 		configParam(SPEED_PARAM, -8.f, 8.f, 1.f, "Modifies the playback speed of the recorded loop");
 		configParam(MUL_PARAM, 0.f, 2.f, 1.f, "Multiplies the output volume");
+
+		control_divider.setDivision(16);
+		// the buffers get built by the widget's first step, or by dataFromJson if there's a patch to load,
+		// so loading a patch only builds them once
+		reallocate = true;
+	}
+
+	~Pete()
+	{
+		banks[0].release();
+		banks[1].release();
+	}
+
+	json_t *dataToJson() override
+	{
+		json_t *root_json = json_object();
+
+		json_object_set_new(root_json, "control_rate", json_integer(control_divider.getDivision()));
+		json_object_set_new(root_json, "interpolation", json_integer(interpolation));
+		json_object_set_new(root_json, "storage_format", json_integer(storage_format));
+		json_object_set_new(root_json, "memory_cap", json_integer(memory_cap));
+		json_object_set_new(root_json, "num_slots", json_integer(num_slots));
+		json_object_set_new(root_json, "base_slot", json_integer(base_slot));
+		json_object_set_new(root_json, "playing_slot", json_integer(playing_slot.load()));
+		json_object_set_new(root_json, "read_pos", json_real(read_pos));
+
+		// each captured slot is saved as its raw samples in loop order, without the frame padding, as one base64 string
+		json_t *slots_json = json_array();
+		for (int s = 0; s < liveBank().num_slots; ++s)
+		{
+			json_t *slot_json = json_object();
+
+			std::vector<uint8_t> loop;
+			int channels, format;
+			if (copySlot(s, loop, channels, format))
+			{
+				json_object_set_new(slot_json, "channels", json_integer(channels));
+				json_object_set_new(slot_json, "format", json_integer(format));
+				json_object_set_new(slot_json, "loop", json_string(encodeBase64(loop.data(), loop.size()).c_str()));
+			}
+
+			json_array_append_new(slots_json, slot_json);
+		}
+		json_object_set_new(root_json, "slots", slots_json);
+
+		return root_json;
+	}
+
+	void dataFromJson(json_t *root_json) override
+	{
+		json_t *temp_json = json_object_get(root_json, "control_rate");
+		if (temp_json)
+			control_divider.setDivision(std::max((int)json_integer_value(temp_json), 1));
+
+		temp_json = json_object_get(root_json, "interpolation");
+		if (temp_json)
+			interpolation = clamp((int)json_integer_value(temp_json), 0, NUM_INTERPOLATIONS - 1);
+
+		temp_json = json_object_get(root_json, "storage_format");
+		if (temp_json)
+			storage_format = clamp((int)json_integer_value(temp_json), 0, PeteBuffer::NUM_FORMATS - 1);
+
+		// patches from before the cap existed were saved without one, and may hold loops longer than the default allows
+		temp_json = json_object_get(root_json, "memory_cap");
+		memory_cap = temp_json ? std::max((int)json_integer_value(temp_json), 0) : 0;
+
+		temp_json = json_object_get(root_json, "num_slots");
+		if (temp_json)
+			num_slots = clamp((int)json_integer_value(temp_json), 1, PETE_MAX_SLOTS);
+
+		// preset loads and pastes can happen while the engine is running, so the loops go into the spare
+		// bank and the audio thread swaps it in, the same as a rebuild from the menu
+		reallocate.store(false);
+		PeteBank &spare = claimSpare();
+		buildBank(spare, APP->engine->getSampleRate());
+
+		json_t *slots_json = json_object_get(root_json, "slots");
+		for (int s = 0; s < spare.num_slots && s < (int)json_array_size(slots_json); ++s)
+		{
+			json_t *slot_json = json_array_get(slots_json, s);
+			json_t *loop_json = json_object_get(slot_json, "loop");
+			json_t *channels_json = json_object_get(slot_json, "channels");
+			json_t *format_json = json_object_get(slot_json, "format");
+			if (loop_json && channels_json && format_json)
+				loadSlot(spare, s, decodeBase64(json_string_value(loop_json), json_string_length(loop_json)),
+						 clamp((int)json_integer_value(channels_json), 1, 16),
+						 clamp((int)json_integer_value(format_json), 0, PeteBuffer::NUM_FORMATS - 1));
+		}
+
+		temp_json = json_object_get(root_json, "base_slot");
+		pending.base_slot = temp_json ? clamp((int)json_integer_value(temp_json), 0, spare.num_slots - 1) : 0;
+
+		temp_json = json_object_get(root_json, "playing_slot");
+		pending.play = temp_json ? clamp((int)json_integer_value(temp_json), 0, spare.num_slots - 1) : pending.base_slot;
+
+		temp_json = json_object_get(root_json, "read_pos");
+		pending.read_pos = temp_json ? clamp((float)json_real_value(temp_json), 0.f, (float)spare.slots[pending.play].size) : 0.f;
+
+		pending.loaded = true;
+		rebuild_state.store(REBUILD_READY);
+	}
+
+	// copies slot s out in loop order without the frame padding. this runs on the ui thread without
+	// taking any locks, so it checks generation afterwards and retries if the engine captured into the
+	// slot or swapped the buffers underneath it. the layout and block addresses are copied out while
+	// generation is even, so a torn copy can read stale samples but never leave the buffer. blocks
+	// only go back to the pool from the ui thread, so the addresses stay good until this returns.
+	// frames that haven't been copied out of the recorder yet are read from there, and read again from
+	// the slot's buffer if the copy passed them in the meantime, since only then can the recorder overwrite them
+	bool copySlot(int s, std::vector<uint8_t> &loop, int &channels, int &format)
+	{
+		std::vector<uint8_t *> block_data, record_block_data;
+		for (int attempt = 0; attempt < 64; ++attempt)
+		{
+			const uint32_t gen = generation.load();
+			if (gen & 1)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			PeteBank &live = liveBank();
+			PeteSlot &slot = live.slots[s];
+			const int start = slot.start, size = slot.size;
+			if (size <= 0)
+				return false;
+
+			PeteBuffer &buffer = live.buffers[s + 1];
+			channels = buffer.channels;
+			format = buffer.format;
+			const int frames = buffer.frames, block_shift = buffer.block_shift, block_mask = buffer.block_mask, frame_shift = buffer.frame_shift;
+			block_data = buffer.block_data;
+
+			PeteBuffer &record_data = live.buffers[0];
+			const int record_frames = record_data.frames, record_block_shift = record_data.block_shift, record_block_mask = record_data.block_mask;
+			record_block_data = record_data.block_data;
+
+			if (generation.load() != gen)
+				continue;
+			// a slot that's been copied in full doesn't need the recorder, which may have changed shape since
+			if (size > frames || (slot.copied.load() < size && (size > record_frames || start >= record_frames || record_data.frame_shift != frame_shift)))
+				return false;
+
+			const size_t frame_bytes = channels * PeteBuffer::sampleSize(format);
+			loop.resize(size * frame_bytes);
+			for (int i = 0; i < size; ++i)
+			{
+				if (i >= slot.copied.load())
+				{
+					int k = start + i;
+					if (k >= record_frames)
+						k -= record_frames;
+					const size_t block = k >> record_block_shift;
+					if (block >= record_block_data.size())
+						break;
+					std::memcpy(&loop[i * frame_bytes], record_block_data[block] + ((k & record_block_mask) << frame_shift), frame_bytes);
+					if (i >= slot.copied.load())
+						continue;
+				}
+
+				const size_t block = i >> block_shift;
+				if (block >= block_data.size())
+					break;
+				std::memcpy(&loop[i * frame_bytes], block_data[block] + ((i & block_mask) << frame_shift), frame_bytes);
+			}
+
+			if (generation.load() == gen)
+				return true;
+		}
+		return false;
+	}
+
+	// restores a loop saved by dataToJson into slot s, converting its sample format if needed
+	void loadSlot(PeteBank &b, int s, const std::vector<uint8_t> &loop, int channels, int format)
+	{
+		PeteBuffer &buffer = b.buffers[s + 1];
+		const size_t sample_bytes = PeteBuffer::sampleSize(format);
+		buffer.setChannels(channels);
+		const int frames = std::min(static_cast<int>(loop.size() / (channels * sample_bytes)), buffer.frames);
+
+		float frame[16] = {};
+		for (int i = 0; i < frames; ++i)
+		{
+			const uint8_t *p = &loop[i * channels * sample_bytes];
+			if (format == buffer.format)
+			{
+				std::memcpy(buffer.frameBytes(i), p, channels * sample_bytes);
+				continue;
+			}
+
+			for (int c = 0; c < channels; ++c)
+			{
+				if (format == PeteBuffer::FORMAT_INT16)
+				{
+					int16_t v;
+					std::memcpy(&v, p + c * sample_bytes, sample_bytes);
+					frame[c] = v / PeteBuffer::INT16_SCALE;
+				}
+				else
+				{
+					std::memcpy(&frame[c], p + c * sample_bytes, sample_bytes);
+				}
+			}
+			buffer.store(i, frame);
+		}
+
+		b.slots[s].start = 0;
+		b.slots[s].size = frames;
+		b.slots[s].copied.store(frames);
+	}
+
+	void onSampleRateChange() override
+	{
+		reallocate = true;
+	}
+
+	// fills b with buffers for the current settings, this is the slow part of a rebuild and never runs on the audio thread
+	void buildBank(PeteBank &b, float sample_rate)
+	{
+		size_t bytes = static_cast<size_t>(60.f * sample_rate * 4.f + 1.f) * PeteBuffer::sampleSize(storage_format);
+		if (memory_cap > 0)
+			bytes = std::min(bytes, (static_cast<size_t>(memory_cap) << 20) / (num_slots + 1));
+		b.allocate(bytes, storage_format, num_slots);
+	}
+
+	// starts over on whatever bank is live, with nothing recorded
+	void resetPlayback()
+	{
+		generation++;
+		data_size = 0;
+		fitRecorder();
+		read_pos = 0.f;
+		overdub_frame = -1;
+		play = std::min(play, bank->num_slots - 1);
+		playing_slot.store(play);
+		base_slot = std::min(base_slot, bank->num_slots - 1);
+		selected_slot = std::min(selected_slot, bank->num_slots - 1);
+		generation++;
+	}
+
+	// the recorder's frame count changes with its channel count and with the bank, and whatever it held before
+	// no longer lines up with the frames, so recording starts over at the beginning of it
+	void fitRecorder()
+	{
+		data_size = std::min(data_size, bank->buffers[0].frames);
+		write_pos = 0;
+		recorded = 0;
+	}
+
+	// audio thread. moves over to the other bank if the ui has finished building it, this costs the same however big it is
+	void swapBanks()
+	{
+		int state = REBUILD_READY;
+		if (!rebuild_state.compare_exchange_strong(state, REBUILD_SWAPPING))
+			return;
+
+		generation++;
+		live_bank.store(1 - live_bank.load());
+		bank = &banks[live_bank.load()];
+		generation++;
+		resetPlayback();
+
+		if (pending.loaded)
+		{
+			pending.loaded = false;
+			play = pending.play;
+			playing_slot.store(play);
+			base_slot = pending.base_slot;
+			selected_slot = base_slot;
+			read_pos = pending.read_pos;
+			// carry on playing the saved loop rather than freezing a new one
+			active = params[ON_PARAM].getValue() > 0.5f && bank->slots[play].size > 0;
+		}
+		else
+		{
+			// every slot of a rebuilt bank is empty, so if it's on it freezes again once the new recorder has a loop in it
+			active = false;
+		}
+
+		rebuild_state.store(REBUILD_SWAPPED);
+	}
+
+	// ui thread. returns the bank the audio thread isn't using, after taking back a build it hasn't swapped in yet,
+	// or handing the buffers it has just moved off back to the pool
+	PeteBank &claimSpare()
+	{
+		int state = REBUILD_READY;
+		if (rebuild_state.compare_exchange_strong(state, REBUILD_IDLE))
+		{
+			pending.loaded = false;
+		}
+		else
+		{
+			while (state == REBUILD_SWAPPING)
+			{
+				std::this_thread::yield();
+				state = rebuild_state.load();
+			}
+			if (state == REBUILD_SWAPPED)
+			{
+				banks[1 - live_bank.load()].release();
+				rebuild_state.store(REBUILD_IDLE);
+			}
+		}
+		return banks[1 - live_bank.load()];
+	}
+
+	// ui thread, called by the widget every frame
+	void stepBanks()
+	{
+		if (rebuild_state.load() == REBUILD_SWAPPED)
+			claimSpare();
+
+		// a build that's ready is left for the audio thread to take, it may hold a loaded patch
+		if (rebuild_state.load() != REBUILD_READY && reallocate.exchange(false))
+		{
+			buildBank(claimSpare(), APP->engine->getSampleRate());
+			rebuild_state.store(REBUILD_READY);
+		}
+	}
+
+	// ui thread
+	PeteBank &liveBank()
+	{
+		return banks[live_bank.load()];
 	}
 
 	float getBPS()
@@ -58,33 +767,208 @@ struct Pete : Module
 			return 60.f / params[BPM_PARAM].getValue();
 	}
 
-	int getDiv()
+	// the loop is divided by 2^n, so store n and shift instead of calling pow
+	int getDivShift()
 	{
-		return pow(2, static_cast<int>(params[DIV_PARAM].getValue() * abs(inputs[DIV_INPUT].getNormalVoltage(10.f)) / 10.f));
+		return clamp(static_cast<int>(params[DIV_PARAM].getValue() * abs(inputs[DIV_INPUT].getNormalVoltage(10.f)) / 10.f), 0, 8);
 	}
 
-	void process(const ProcessArgs &args) override
+	// where playback jumps back to, the last 1/div of the loop
+	float getLoopStart()
 	{
-		const int data_size = static_cast<int>(getBPS() * args.sampleRate * 4.f);
-		if (data_size == 0)
-			return;
+		return bank->slots[play].size - (bank->slots[play].size >> div_shift);
+	}
+
+	// where frame k of the playing loop is, wrapping around both ends of the loop. that's the slot's own
+	// buffer once the frame has been copied there, and the recorder until then
+	PeteBuffer &loopFrame(int k, int &i)
+	{
+		const PeteSlot &slot = bank->slots[play];
+		k %= slot.size;
+		if (k < 0)
+			k += slot.size;
+
+		if (k < slot.copied.load(std::memory_order_relaxed))
+		{
+			i = k;
+			return bank->buffers[play + 1];
+		}
+
+		i = slot.start + k;
+		if (i >= bank->buffers[0].frames)
+			i -= bank->buffers[0].frames;
+		return bank->buffers[0];
+	}
+
+	// reads the playing loop at read_pos into out, one float_4 per group of 4 channels.
+	// each mode is a straight loop over the groups so it compiles down to packed math
+	void readLoop(simd::float_4 *out)
+	{
+		const int i = static_cast<int>(read_pos);
+		const simd::float_4 t = read_pos - i;
+		const int stride = bank->buffers[play + 1].stride;
 
-		if ((int)record_data.size() != data_size)
+		switch (interpolation)
 		{
-			while ((int)record_data.size() < data_size)
+		case INTERPOLATION_NEAREST:
+		{
+			int x0;
+			PeteBuffer &b0 = loopFrame(i, x0);
+			for (int c = 0; c < stride; c += 4)
+				out[c / 4] = b0.load(x0, c);
+			break;
+		}
+		case INTERPOLATION_LINEAR:
+		{
+			int x0, x1;
+			PeteBuffer &b0 = loopFrame(i, x0), &b1 = loopFrame(i + 1, x1);
+			for (int c = 0; c < stride; c += 4)
 			{
-				record_data.push_back(0.f);
+				const simd::float_4 y0 = b0.load(x0, c);
+				out[c / 4] = y0 + (b1.load(x1, c) - y0) * t;
 			}
-			while ((int)record_data.size() > data_size)
+			break;
+		}
+		case INTERPOLATION_HERMITE:
+		{
+			int xm1, x0, x1, x2;
+			PeteBuffer &bm1 = loopFrame(i - 1, xm1), &b0 = loopFrame(i, x0), &b1 = loopFrame(i + 1, x1), &b2 = loopFrame(i + 2, x2);
+			for (int c = 0; c < stride; c += 4)
 			{
-				record_data.pop_back();
+				const simd::float_4 ym1 = bm1.load(xm1, c);
+				const simd::float_4 y0 = b0.load(x0, c);
+				const simd::float_4 y1 = b1.load(x1, c);
+				const simd::float_4 y2 = b2.load(x2, c);
+
+				const simd::float_4 c1 = 0.5f * (y1 - ym1);
+				const simd::float_4 c2 = ym1 - 2.5f * y0 + 2.f * y1 - 0.5f * y2;
+				const simd::float_4 c3 = 0.5f * (y2 - ym1) + 1.5f * (y0 - y1);
+				out[c / 4] = ((c3 * t + c2) * t + c1) * t + y0;
 			}
+			break;
 		}
+		}
+	}
+
+	// pins the last data_size frames of the recorder as slot s, to be copied into its buffer by copySlice
+	void capture(int s)
+	{
+		generation++;
+		bank->buffers[s + 1].setChannels(bank->buffers[0].channels);
+		bank->slots[s].start = write_pos >= data_size ? write_pos - data_size : write_pos - data_size + bank->buffers[0].frames;
+		bank->slots[s].size = data_size;
+		bank->slots[s].copied.store(0);
+		generation++;
+		overdub_frame = -1;
+	}
 
-		if (inputs[INPUT_INPUT].isConnected())
+	// copies the next COPY_SLICE frames of slot s out of the recorder, oldest first.
+	// returns whether there is any of it left to copy
+	bool copySlice(int s)
+	{
+		PeteSlot &slot = bank->slots[s];
+		const int copied = slot.copied.load(std::memory_order_relaxed);
+		if (copied >= slot.size)
+			return false;
+
+		PeteBuffer &record_data = bank->buffers[0], &buffer = bank->buffers[s + 1];
+		const size_t frame_bytes = (size_t)1 << record_data.frame_shift;
+		const int end = std::min(copied + COPY_SLICE, slot.size);
+
+		int k = slot.start + copied;
+		if (k >= record_data.frames)
+			k -= record_data.frames;
+		for (int i = copied; i < end; ++i)
+		{
+			std::memcpy(buffer.frameBytes(i), record_data.frameBytes(k), frame_bytes);
+			if (++k >= record_data.frames)
+				k = 0;
+		}
+
+		slot.copied.store(end);
+		return end < slot.size;
+	}
+
+	// starts playing slot s from the top, if anything has been captured into it
+	void recall(int s)
+	{
+		if (bank->slots[s].size == 0)
+			return;
+		play = s;
+		playing_slot.store(s);
+		read_pos = getLoopStart();
+		overdub_frame = -1;
+	}
+
+	void updateControls(float sample_rate)
+	{
+		data_size = clamp(static_cast<int>(getBPS() * sample_rate * 4.f), 0, bank->buffers[0].frames);
+		div_shift = getDivShift();
+
+		const float block = control_divider.getDivision();
+		speed_step = (params[SPEED_PARAM].getValue() * abs(inputs[SPEED_INPUT].getNormalVoltage(10.f)) / 10.f - speed) / block;
+		gain_step = (params[MUL_PARAM].getValue() * inputs[MUL_INPUT].getNormalVoltage(10.f) / 10.f - gain) / block;
+
+		const int requested = requested_slot.exchange(-1);
+		if (requested >= 0)
 		{
-			record_data[write_pos % data_size] = inputs[INPUT_INPUT].getVoltage();
-			write_pos = (write_pos + 1) % data_size;
+			base_slot = std::min(requested, bank->num_slots - 1);
+			if (active)
+				recall(base_slot);
+		}
+
+		int slot = base_slot;
+		if (inputs[SLOT_INPUT].isConnected())
+			slot = clamp(static_cast<int>(abs(inputs[SLOT_INPUT].getVoltage()) / 10.f * bank->num_slots), 0, bank->num_slots - 1);
+		if (slot != selected_slot)
+		{
+			selected_slot = slot;
+			if (active)
+				recall(slot);
+		}
+	}
+
+	void process(const ProcessArgs &args) override
+	{
+		if (rebuild_state.load() == REBUILD_READY)
+			swapBanks();
+		// nothing to record into until the first bank has been built
+		if (bank->num_slots == 0)
+		{
+			passThrough(inputs[INPUT_INPUT].getChannels());
+			return;
+		}
+
+		// captures still being copied come first, so their oldest frames are safe before the recorder writes over them
+		bool copying = false;
+		for (int s = 0; s < bank->num_slots; ++s)
+			copying |= copySlice(s);
+
+		// the recorder only changes shape once nothing is being copied out of it, until then the new
+		// channels are recorded in the old layout
+		PeteBuffer &record_data = bank->buffers[0];
+		const int channels = inputs[INPUT_INPUT].getChannels();
+		if (channels > 0 && channels != record_data.channels && !copying)
+		{
+			record_data.setChannels(channels);
+			fitRecorder();
+		}
+
+		if (control_divider.process() || data_size == 0)
+			updateControls(args.sampleRate);
+		if (data_size == 0)
+			return;
+
+		speed += speed_step;
+		gain += gain_step;
+
+		if (channels > 0)
+		{
+			record_data.store(write_pos, inputs[INPUT_INPUT].getVoltages());
+			if (++write_pos >= record_data.frames)
+				write_pos = 0;
+			if (recorded < record_data.frames)
+				++recorded;
 		}
 
 		bool now_active = params[ON_PARAM].getValue() > 0.5f;
@@ -96,31 +980,101 @@ struct Pete : Module
 				params[ON_PARAM].setValue(now_active ? 1.f : 0.f);
 			}
 		}
+		// until the recorder holds a whole loop it keeps passing the input through, and tries again next sample
+		if (now_active && !active && recorded < data_size)
+			now_active = false;
+
+		if (inputs[CAPTURE_INPUT].isConnected())
+		{
+			if (capture_trigger.process(rescale(inputs[CAPTURE_INPUT].getVoltage(), 0.1f, 2.f, 0.f, 1.f)))
+			{
+				capture(selected_slot);
+				if (active && selected_slot == play)
+					read_pos = getLoopStart();
+			}
+		}
 
 		if (now_active)
 		{ // currently active
 			if (!active)
 			{ // was not previously active
-				playback_data.assign(record_data.begin(), record_data.end());
-				read_pos = static_cast<int>((1.f - (float)1.f / getDiv()) * playback_data.size());
+				capture(selected_slot);
+				recall(selected_slot);
 			}
 
-			if (outputs[OUTPUT_OUTPUT].isConnected() && inputs[INPUT_INPUT].isConnected())
-				outputs[OUTPUT_OUTPUT].setVoltage(playback_data[static_cast<int>(read_pos) % playback_data.size()] * params[MUL_PARAM].getValue() * inputs[MUL_INPUT].getNormalVoltage(10.f) / 10.f);
+			PeteSlot &slot = bank->slots[play];
+			if (slot.size > 0)
+			{
+				PeteBuffer &buffer = bank->buffers[play + 1];
+				if (outputs[OUTPUT_OUTPUT].isConnected() && inputs[INPUT_INPUT].isConnected())
+				{
+					simd::float_4 out[4];
+					readLoop(out);
+
+					outputs[OUTPUT_OUTPUT].setChannels(buffer.channels);
+					if (buffer.stride >= 4)
+					{
+						for (int c = 0; c < buffer.stride; c += 4)
+							outputs[OUTPUT_OUTPUT].setVoltageSimd(out[c / 4] * gain, c);
+					}
+					else
+					{
+						for (int c = 0; c < buffer.stride; ++c)
+							outputs[OUTPUT_OUTPUT].setVoltage(out[0][c] * gain, c);
+					}
+				}
+
+				// overdub mixes the input into the playing loop, under the read head. each frame the head moves onto
+				// gets the input once, along with any it skipped over, so one pass adds it at unity whatever the speed.
+				// frames still in the recorder are left alone, the recording has to stay as it was for later captures
+				if (inputs[OVERDUB_INPUT].getVoltage() >= 1.f && channels == buffer.channels)
+				{
+					const int k = static_cast<int>(read_pos);
+					if (k != overdub_frame)
+					{
+						const int dir = k > overdub_frame ? 1 : -1;
+						int j = overdub_frame >= 0 && std::abs(k - overdub_frame) <= OVERDUB_MAX_STEP ? overdub_frame + dir : k;
+						for (;; j += dir)
+						{
+							int i;
+							if (&loopFrame(j, i) == &buffer)
+								buffer.overdub(i, inputs[INPUT_INPUT].getVoltages());
+							if (j == k)
+								break;
+						}
+						overdub_frame = k;
+					}
+				}
+				else
+				{
+					overdub_frame = -1;
+				}
+			}
 
-			read_pos += params[SPEED_PARAM].getValue() * abs(inputs[SPEED_INPUT].getNormalVoltage(10.f)) / 10.f;
+			read_pos += speed;
 
-			if (read_pos > (int)playback_data.size() || read_pos < 0)
-				read_pos = static_cast<int>((1.f - (float)1.f / getDiv()) * playback_data.size());
+			if (read_pos >= slot.size || read_pos < 0)
+				read_pos = getLoopStart();
 		}
 		else
 		{
-			if (outputs[OUTPUT_OUTPUT].isConnected())
-				outputs[OUTPUT_OUTPUT].setVoltage(inputs[INPUT_INPUT].getNormalVoltage(0.f));
+			passThrough(channels);
 		}
 
 		active = now_active;
 	}
+
+	void passThrough(int channels)
+	{
+		if (outputs[OUTPUT_OUTPUT].isConnected())
+		{
+			outputs[OUTPUT_OUTPUT].setChannels(std::max(channels, 1));
+			for (int c = 0; c < channels; c += 4)
+				outputs[OUTPUT_OUTPUT].setVoltageSimd(inputs[INPUT_INPUT].getVoltageSimd<simd::float_4>(c), c);
+			if (channels == 0)
+				outputs[OUTPUT_OUTPUT].setVoltage(0.f);
+		}
+	}
 };
 
 struct PeteWidget : ModuleWidget
@@ -143,8 +1097,160 @@ struct PeteWidget : ModuleWidget
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(15.24, 94.367)), module, Pete::SPEED_INPUT));
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(15.24, 110.43)), module, Pete::MUL_INPUT));
 
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(25.4, 62.242)), module, Pete::SLOT_INPUT));
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(25.4, 78.305)), module, Pete::CAPTURE_INPUT));
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(25.4, 94.367)), module, Pete::OVERDUB_INPUT));
+
 		addOutput(createOutputCentered<PJ301MOutputPort>(mm2px(Vec(12.7, 28.109)), module, Pete::OUTPUT_OUTPUT));
 	}
+
+	struct ControlRateItem : MenuItem
+	{
+		Pete *module;
+		int rate;
+
+		void onAction(const event::Action &e) override
+		{
+			module->control_divider.setDivision(rate);
+		}
+	};
+
+	struct InterpolationItem : MenuItem
+	{
+		Pete *module;
+		int interpolation;
+
+		void onAction(const event::Action &e) override
+		{
+			module->interpolation = interpolation;
+		}
+	};
+
+	struct StorageFormatItem : MenuItem
+	{
+		Pete *module;
+		int storage_format;
+
+		void onAction(const event::Action &e) override
+		{
+			module->storage_format = storage_format;
+			module->reallocate.store(true);
+		}
+	};
+
+	struct MemoryCapItem : MenuItem
+	{
+		Pete *module;
+		int memory_cap;
+
+		void onAction(const event::Action &e) override
+		{
+			module->memory_cap = memory_cap;
+			module->reallocate.store(true);
+		}
+	};
+
+	struct NumSlotsItem : MenuItem
+	{
+		Pete *module;
+		int num_slots;
+
+		void onAction(const event::Action &e) override
+		{
+			module->num_slots = num_slots;
+			module->reallocate.store(true);
+		}
+	};
+
+	struct RecallItem : MenuItem
+	{
+		Pete *module;
+		int slot;
+
+		void onAction(const event::Action &e) override
+		{
+			module->requested_slot.store(slot);
+		}
+	};
+
+	// buffer rebuilds happen here, on the ui thread, rather than in process()
+	void step() override
+	{
+		Pete *module = dynamic_cast<Pete *>(this->module);
+		if (module)
+			module->stepBanks();
+		ModuleWidget::step();
+	}
+
+	void appendContextMenu(Menu *menu) override
+	{
+		Pete *module = dynamic_cast<Pete *>(this->module);
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Slots"));
+		for (int n : {1, 2, 4, 8})
+		{
+			NumSlotsItem *item = createMenuItem<NumSlotsItem>(string::f("%d", n), CHECKMARK(module->num_slots == n));
+			item->module = module;
+			item->num_slots = n;
+			menu->addChild(item);
+		}
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Recall slot"));
+		const int playing = module->playing_slot.load();
+		PeteBank &live = module->liveBank();
+		for (int s = 0; s < live.num_slots; ++s)
+		{
+			RecallItem *item = createMenuItem<RecallItem>(string::f("%d%s", s + 1, live.slots[s].size > 0 ? "" : " (empty)"), CHECKMARK(playing == s));
+			item->module = module;
+			item->slot = s;
+			menu->addChild(item);
+		}
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Storage"));
+		const std::string format_names[PeteBuffer::NUM_FORMATS] = {"32-bit float", "16-bit integer"};
+		for (int i = 0; i < PeteBuffer::NUM_FORMATS; ++i)
+		{
+			StorageFormatItem *item = createMenuItem<StorageFormatItem>(format_names[i], CHECKMARK(module->storage_format == i));
+			item->module = module;
+			item->storage_format = i;
+			menu->addChild(item);
+		}
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel(string::f("Memory cap (using %.1f MB)", module->liveBank().allocatedBytes() / 1048576.f)));
+		for (int cap : {0, 16, 64, 256})
+		{
+			MemoryCapItem *item = createMenuItem<MemoryCapItem>(cap == 0 ? "Unlimited" : string::f("%d MB", cap), CHECKMARK(module->memory_cap == cap));
+			item->module = module;
+			item->memory_cap = cap;
+			menu->addChild(item);
+		}
+		menu->addChild(createMenuLabel(string::f("Shared pool: %.1f MB, %.1f MB free", pete_pool.totalBytes() / 1048576.f, pete_pool.freeBytes() / 1048576.f)));
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Interpolation"));
+		const std::string interpolation_names[Pete::NUM_INTERPOLATIONS] = {"Nearest", "Linear", "Hermite"};
+		for (int i = 0; i < Pete::NUM_INTERPOLATIONS; ++i)
+		{
+			InterpolationItem *item = createMenuItem<InterpolationItem>(interpolation_names[i], CHECKMARK(module->interpolation == i));
+			item->module = module;
+			item->interpolation = i;
+			menu->addChild(item);
+		}
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Control rate"));
+		for (int rate : {1, 16, 32, 64})
+		{
+			ControlRateItem *item = createMenuItem<ControlRateItem>(rate == 1 ? "Every sample" : string::f("Every %d samples", rate), CHECKMARK((int)module->control_divider.getDivision() == rate));
+			item->module = module;
+			item->rate = rate;
+			menu->addChild(item);
+		}
+	}
 };
 
 Model *modelPete = createModel<Pete, PeteWidget>("pete");
\ No newline at end of file
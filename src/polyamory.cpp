@@ -36,109 +36,179 @@ struct Polyamory : Module
 		NUM_LIGHTS
 	};
 
+	// in matrix mode every channel of the width, center and mul cvs is a window of its own, and the output
+	// carries one channel per window. otherwise there is just the one window, and a mono output
+	static const int MAX_WINDOWS = 16;
+	bool matrix = false;
+
+	// width and center are read every BLOCK samples. a window's weights are only worked out again when one of
+	// them moves by more than EPSILON (or the number of channels or windows changes), and then slide to the new
+	// values over the next block so a moving window doesn't click. the rest of the time a sample is just the
+	// matrix-vector product
+	static const int BLOCK = 16;
+	static constexpr float EPSILON = 1e-4f;
+
+	dsp::ClockDivider control_divider;
+
+	float last_w[MAX_WINDOWS] = {}, last_c[MAX_WINDOWS] = {};
+	int last_channels = 0, last_windows = 0;
+
+	// a row per window, four input channels per float_4
+	simd::float_4 weights[MAX_WINDOWS][4] = {}, targets[MAX_WINDOWS][4] = {}, steps[MAX_WINDOWS][4] = {};
+	int ramp = 0;
+
+	// the first window over four evenly spaced points, for the lights
+	simd::float_4 light_weights = 0.f;
+
 	Polyamory()
 	{
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(WIDTH_PARAM, 0.f, 1.f, 0.1f, "The width of the region");
 		configParam(CENTER_PARAM, 0.f, 1.f, 0.5f, "The center of the region, [0,1] -> [a,d]");
 		configParam(MUL_PARAM, 0.f, 2.f, 1.f, "Multiplies the output");
+
+		control_divider.setDivision(BLOCK);
 	}
 
-	void process(const ProcessArgs &args) override
+	json_t *dataToJson() override
+	{
+		json_t *root_json = json_object();
+
+		json_object_set_new(root_json, "matrix", json_boolean(matrix));
+
+		return root_json;
+	}
+	void dataFromJson(json_t *root_json) override
+	{
+		json_t *temp_json = json_object_get(root_json, "matrix");
+		if (temp_json)
+			matrix = json_boolean_value(temp_json);
+	}
+
+	// the middle of each channel in a group of four, (i + 0.5) for i in [0,3]
+	const simd::float_4 LANES = simd::float_4(0.5f, 1.5f, 2.5f, 3.5f);
+
+	// the volume of an input at position x, it falls off linearly from the center and is 0 outside the width
+	static simd::float_4 window(simd::float_4 x, float c, float w)
 	{
+		return simd::fmax(w - simd::abs(c - x), 0.f);
+	}
 
-		const float w = params[WIDTH_PARAM].getValue() * abs(inputs[WIDTH_INPUT].getNormalVoltage(10.f)) / 10.f;
-		const float c = params[CENTER_PARAM].getValue() * abs(inputs[CENTER_INPUT].getNormalVoltage(10.f)) / 10.f;
-		const float m = params[MUL_PARAM].getValue() * abs(inputs[MUL_INPUT].getNormalVoltage(10.f)) / 10.f;
+	void updateWeights(int channels, int windows)
+	{
+		const bool resized = channels != last_channels || windows != last_windows;
+		last_channels = channels;
+		last_windows = windows;
 
-		if (inputs[A_INPUT].isConnected())
+		bool changed = false;
+		for (int j = 0; j < windows; ++j)
 		{
-			if (inputs[A_INPUT].isPolyphonic())
+			const float w = params[WIDTH_PARAM].getValue() * abs(inputs[WIDTH_INPUT].getNormalPolyVoltage(10.f, j)) / 10.f;
+			const float c = params[CENTER_PARAM].getValue() * abs(inputs[CENTER_INPUT].getNormalPolyVoltage(10.f, j)) / 10.f;
+
+			// the last ramp always ends before the next block, so a window that hasn't moved can keep its weights
+			if (!resized && abs(w - last_w[j]) <= EPSILON && abs(c - last_c[j]) <= EPSILON)
+			{
+				for (int i = 0; i < channels; i += 4)
+					steps[j][i / 4] = 0.f;
+				continue;
+			}
+
+			changed = true;
+			last_w[j] = w;
+			last_c[j] = c;
+
+			// lanes past the end of the cable get no weight, so the product can always read whole groups
+			for (int i = 0; i < channels; i += 4)
 			{
-				// use A's inputs instead of b,c,d
-				std::vector<float> r;
-				r.assign(inputs[A_INPUT].getChannels(), 0.f);
-
-				float sum = 0.f;
-				for (size_t i = 0; i < r.size(); ++i)
-				{
-
-					const float x = (float)(i + 0.5f) / r.size();
-					const float d = abs(c - x);
-
-					if (d >= w)
-					{
-						r[i] = 0.f;
-					}
-					else
-					{
-						r[i] = w - d;
-					}
-
-					sum += r[i] * inputs[A_INPUT].getVoltage(i);
-				}
-
-				sum /= r.size();
-				sum *= m;
-				outputs[OUTPUT_OUTPUT].setVoltage(sum);
-
-				for (int i = 0; i < 4; ++i)
-				{
-					const float x = (float)(i + 0.5f) / 4.f;
-					const float d = abs(c - x);
-
-					if (d >= w)
-					{
-						r[i] = 0.f;
-					}
-					else
-					{
-						r[i] = w - d;
-					}
-
-					lights[i].setSmoothBrightness(r[i] * m, 0.01);
-				}
-
-				return;
+				const simd::float_4 index = LANES + static_cast<float>(i);
+				targets[j][i / 4] = simd::ifelse(index < static_cast<float>(channels), window(index / channels, c, w), 0.f);
+
+				// when the channels change the old weights belonged to other positions, so there is nothing to slide from
+				if (resized)
+					weights[j][i / 4] = targets[j][i / 4];
+				steps[j][i / 4] = (targets[j][i / 4] - weights[j][i / 4]) / static_cast<float>(BLOCK);
 			}
+
+			if (j == 0)
+				light_weights = window(LANES / 4.f, c, w);
 		}
 
-		// otherwise, use a,b,c,d's inputs
-		float r[4] = {0.f};
+		if (changed)
+			ramp = resized ? 0 : BLOCK;
+	}
+
+	void process(const ProcessArgs &args) override
+	{
+		// use A's inputs instead of b,c,d when it is polyphonic
+		const bool poly = inputs[A_INPUT].isConnected() && inputs[A_INPUT].isPolyphonic();
+		const int channels = poly ? inputs[A_INPUT].getChannels() : 4;
+
+		int windows = 1;
+		if (matrix)
+		{
+			windows = std::max(windows, inputs[WIDTH_INPUT].getChannels());
+			windows = std::max(windows, inputs[CENTER_INPUT].getChannels());
+			windows = std::max(windows, inputs[MUL_INPUT].getChannels());
+		}
 
-		int num_connections = 0;
-		float sum = 0.f;
-		for (int i = 0; i < 4; ++i)
+		if (control_divider.process() || channels != last_channels || windows != last_windows)
 		{
-			if (inputs[i].isConnected())
-				++num_connections;
+			updateWeights(channels, windows);
 
-			const float x = (float)(i + 0.5f) / 4.f;
-			const float d = abs(c - x);
+			const float m = params[MUL_PARAM].getValue() * abs(inputs[MUL_INPUT].getNormalVoltage(10.f)) / 10.f;
+			for (int i = 0; i < 4; ++i)
+				lights[i].setSmoothBrightness(light_weights[i] * m, args.sampleTime * BLOCK);
+		}
 
-			if (d >= w)
+		if (ramp > 0)
+		{
+			--ramp;
+			for (int j = 0; j < windows; ++j)
 			{
-				r[i] = 0.f;
+				for (int i = 0; i < channels; i += 4)
+					weights[j][i / 4] = ramp > 0 ? weights[j][i / 4] + steps[j][i / 4] : targets[j][i / 4];
 			}
-			else
+		}
+
+		simd::float_4 x[4];
+		float scale;
+		if (poly)
+		{
+			for (int i = 0; i < channels; i += 4)
+				x[i / 4] = inputs[A_INPUT].getVoltageSimd<simd::float_4>(i);
+			scale = 1.f / channels;
+		}
+		else
+		{
+			// otherwise, use a,b,c,d's inputs
+			int num_connections = 0;
+			for (int i = 0; i < 4; ++i)
 			{
-				r[i] = w - d;
+				if (inputs[i].isConnected())
+					++num_connections;
+				x[0][i] = inputs[i].getNormalVoltage(0.f);
 			}
-
-			sum += r[i] * inputs[i].getNormalVoltage(0.f);
-
-			lights[i].setSmoothBrightness(r[i] * m, 0.01);
+			scale = num_connections > 0 ? 1.f / num_connections : 0.f;
 		}
 
-		if (num_connections == 0)
+		// the product is done a block of four windows at a time. each window's row is summed four channels
+		// at a time, and the four lane sums are only added together once per window
+		outputs[OUTPUT_OUTPUT].setChannels(windows);
+		for (int j = 0; j < windows; j += 4)
 		{
-			outputs[OUTPUT_OUTPUT].setVoltage(0.f);
-			return;
-		}
+			simd::float_4 out = 0.f;
+			for (int k = 0; k < 4 && j + k < windows; ++k)
+			{
+				simd::float_4 sum = 0.f;
+				for (int i = 0; i < channels; i += 4)
+					sum += weights[j + k][i / 4] * x[i / 4];
+				out[k] = sum[0] + sum[1] + sum[2] + sum[3];
+			}
 
-		sum /= num_connections;
-		sum *= m;
-		outputs[OUTPUT_OUTPUT].setVoltage(sum);
+			const simd::float_4 m = params[MUL_PARAM].getValue() * simd::abs(inputs[MUL_INPUT].getNormalPolyVoltageSimd<simd::float_4>(10.f, j)) / 10.f;
+			outputs[OUTPUT_OUTPUT].setVoltageSimd(out * scale * m, j);
+		}
 	}
 };
 
@@ -168,6 +238,27 @@ struct PolyamoryWidget : ModuleWidget
 		addChild(createLightCentered<MediumLight<PinkLight>>(mm2px(Vec(25.4, 51.159)), module, Polyamory::C_LIGHT));
 		addChild(createLightCentered<MediumLight<PinkLight>>(mm2px(Vec(35.56, 51.159)), module, Polyamory::D_LIGHT));
 	}
+
+	struct MatrixItem : MenuItem
+	{
+		Polyamory *module;
+
+		void onAction(const event::Action &e) override
+		{
+			module->matrix = !module->matrix;
+		}
+	};
+
+	void appendContextMenu(Menu *menu) override
+	{
+		Polyamory *module = dynamic_cast<Polyamory *>(this->module);
+
+		menu->addChild(new MenuEntry);
+
+		MatrixItem *matrix_item = createMenuItem<MatrixItem>("Matrix mode", CHECKMARK(module->matrix));
+		matrix_item->module = module;
+		menu->addChild(matrix_item);
+	}
 };
 
 Model *modelPolyamory = createModel<Polyamory, PolyamoryWidget>("polyamory");
\ No newline at end of file
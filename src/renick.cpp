@@ -1,6 +1,116 @@
 #include "plugin.hpp"
 
 #include "common.hpp"
+#include <thread>
+
+//==================================================
+// A word or rule, stored inline with a fixed capacity so that nothing the audio thread does allocates
+template <int N>
+struct RenickString
+{
+	int symbols[N] = {};
+	int length = 0;
+
+	int size() const { return length; }
+	void clear() { length = 0; }
+
+	void push_back(const int s)
+	{
+		if (length < N)
+			symbols[length++] = s;
+	}
+
+	int operator[](const int i) const { return symbols[i]; }
+	const int *begin() const { return symbols; }
+	const int *end() const { return symbols + length; }
+};
+
+//==================================================
+// A word of up to N symbols from an alphabet of 16, packed 4 bits to a symbol
+template <int N>
+struct RenickPackedWord
+{
+	uint8_t data[N / 2] = {};
+	int length = 0;
+
+	int size() const { return length; }
+	void clear() { length = 0; }
+
+	void push_back(const int s)
+	{
+		if (length >= N)
+			return;
+		const int shift = (length & 1) << 2;
+		data[length >> 1] = (data[length >> 1] & ~(15 << shift)) | ((s & 15) << shift);
+		++length;
+	}
+
+	int operator[](const int i) const
+	{
+		return (data[i >> 1] >> ((i & 1) << 2)) & 15;
+	}
+
+	// copies only the bytes in use, which for most words is far less than the whole capacity
+	void assign(const RenickPackedWord &other)
+	{
+		std::memcpy(data, other.data, (other.length + 1) / 2);
+		length = other.length;
+	}
+};
+
+//==================================================
+// Words and rules are saved as strings of letters, a to p, one per symbol
+template <typename T>
+static std::string renickToLetters(const T &symbols)
+{
+	std::string letters(symbols.size(), 'a');
+	for (int i = 0; i < symbols.size(); ++i)
+		letters[i] += symbols[i];
+	return letters;
+}
+
+// replaces symbols with a string of letters, or with an array of symbol numbers from older patches
+template <typename T>
+static void renickFromJson(T &symbols, json_t *symbols_json)
+{
+	symbols.clear();
+	if (json_is_string(symbols_json))
+	{
+		const char *letters = json_string_value(symbols_json);
+		const size_t length = json_string_length(symbols_json);
+		for (size_t i = 0; i < length; ++i)
+		{
+			if (letters[i] >= 'a' && letters[i] <= 'p')
+				symbols.push_back(letters[i] - 'a');
+		}
+	}
+	else if (json_is_array(symbols_json))
+	{
+		for (size_t i = 0; i < json_array_size(symbols_json); ++i)
+			symbols.push_back(clamp((int)json_integer_value(json_array_get(symbols_json, i)), 0, 15));
+	}
+}
+
+//==================================================
+// An edit made in the ui. These are queued up and applied by the audio thread at the start of a sample,
+// so the words and rules are only ever changed from one thread
+struct RenickCommand
+{
+	enum Type
+	{
+		ADD_LETTER,
+		CLEAR_RULE,
+		RESET,
+		SET_LARGE,
+		SET_VOICES,
+		SET_AXIOM
+	};
+
+	Type type;
+	int voice;
+	int rule;
+	int letter;
+};
 
 struct Renick : Module
 {
@@ -31,18 +141,69 @@ struct Renick : Module
 		NUM_LIGHTS
 	};
 
-	dsp::Timer timer;
-	dsp::PulseGenerator pulse;
-	dsp::SchmittTrigger trigger;
-
-	std::vector<int> rules[4];
-	std::vector<int> word;
-	int selection = 0;
-	int pos = 0;
-	float dur = 500.0f;
+	dsp::ClockDivider control_divider;
+	dsp::RingBuffer<RenickCommand, 64> commands;
 
 	const static int WORD_MAX = 16;
 	const static int RULE_MAX = 8;
+	const static int SYMBOLS = 4;
+
+	// large mode, which has 16 symbols and words of up to LARGE_WORD_MAX
+	const static int LARGE_WORD_MAX = 32768;
+	const static int LARGE_SYMBOLS = 16;
+
+	// how many symbols of the current word get expanded into the next generation each sample
+	const static int EXPAND_SLICE = 4;
+
+	const static int MAX_VOICES = 16;
+
+	// every voice is its own l-system, with its own axiom, rules, word and position, and comes out on its
+	// own channel of the gate output. the state is kept as one array per field rather than one struct per
+	// voice, so the per-sample countdown is a straight loop over ints that vectorizes.
+	//
+	// each voice's word is double buffered. while one generation plays, the next one is expanded into the
+	// other buffer a slice at a time, and swapped in when the word wraps. if it isn't finished by then, the
+	// current generation plays again rather than expanding the rest in one go
+	RenickString<RULE_MAX> rules[MAX_VOICES][LARGE_SYMBOLS];
+	RenickPackedWord<LARGE_WORD_MAX> words[MAX_VOICES][2];
+	int word_index[MAX_VOICES] = {};
+	int expand_pos[MAX_VOICES] = {};
+	bool expanded[MAX_VOICES] = {};
+	int axiom[MAX_VOICES] = {};
+	int pos[MAX_VOICES] = {};
+	float dur[MAX_VOICES] = {};
+	int num_voices = 1;
+	bool large = false;
+
+	// each symbol is counted down in whole samples. the part of a sample left over at the end of one symbol is
+	// carried into the next, so durations that aren't a whole number of samples still come out right on average.
+	// the knobs and time are only read when a symbol starts, and every control_divider samples
+	int remaining[MAX_VOICES] = {}, symbol_samples[MAX_VOICES] = {}, pulse_samples[MAX_VOICES] = {};
+	float symbol_carry[MAX_VOICES] = {}, next_carry[MAX_VOICES] = {};
+
+	// which voice and rule the buttons and displays are editing, these belong to the ui
+	int edit_voice = 0;
+	int selection = 0;
+
+	// a patch or preset load reads everything into loaded on the ui thread, and the audio thread takes it in
+	// at the start of a sample, like the edits. load_state goes idle -> ready -> applying -> idle
+	struct Patch
+	{
+		RenickString<RULE_MAX> rules[MAX_VOICES][LARGE_SYMBOLS];
+		RenickPackedWord<LARGE_WORD_MAX> words[MAX_VOICES];
+		int axiom[MAX_VOICES] = {};
+		int pos[MAX_VOICES] = {};
+		int num_voices = 1;
+		bool large = false;
+	};
+	enum LoadState
+	{
+		LOAD_IDLE,
+		LOAD_READY,
+		LOAD_APPLYING
+	};
+	std::unique_ptr<Patch> loaded;
+	std::atomic<int> load_state{LOAD_IDLE};
 
 	//==================================================
 	Renick()
@@ -53,124 +214,373 @@ struct Renick : Module
 		configParam(C_PARAM, 0.f, 1000.f, 750.f, "Sets the duration of symbol c");
 		configParam(D_PARAM, 0.f, 1000.f, 1000.f, "Sets the duration of symbol d");
 		configParam(TIME_PARAM, 0.f, 16.f, 1.f, "Divides the durations of all symbols");
+
+		control_divider.setDivision(32);
+
+		// voices start from a, b, c, d, a, ... so they don't all play the same thing
+		for (int v = 0; v < MAX_VOICES; ++v)
+			axiom[v] = v % SYMBOLS;
 	}
 
 	//==================================================
+	// words and rules are saved as strings of letters, one per symbol
+	void voiceToJson(const int v, json_t *voice_json)
+	{
+		json_object_set_new(voice_json, "pos", json_integer(pos[v]));
+		json_object_set_new(voice_json, "axiom", json_integer(axiom[v]));
+		json_object_set_new(voice_json, "word", json_string(renickToLetters(word(v)).c_str()));
+
+		json_t *rules_json = json_array();
+		for (int i = 0; i < getSymbols(); ++i)
+			json_array_append_new(rules_json, json_string(renickToLetters(rules[v][i]).c_str()));
+		json_object_set_new(voice_json, "rules", rules_json);
+	}
+
+	// reads voice v of a patch, replacing rather than adding to what was there. patches saved before the words were
+	// strings have arrays of symbols instead, and a rule_<n> key per rule
+	void voiceFromJson(Patch &patch, const int v, json_t *voice_json)
+	{
+		renickFromJson(patch.words[v], json_object_get(voice_json, "word"));
+
+		json_t *rules_json = json_object_get(voice_json, "rules");
+		for (int i = 0; i < LARGE_SYMBOLS; ++i)
+		{
+			json_t *rule_json = rules_json ? json_array_get(rules_json, i) : json_object_get(voice_json, ("rule_" + std::to_string(i)).c_str());
+			renickFromJson(patch.rules[v][i], rule_json);
+		}
+
+		json_t *temp_json = json_object_get(voice_json, "axiom");
+		patch.axiom[v] = temp_json ? clamp((int)json_integer_value(temp_json), 0, LARGE_SYMBOLS - 1) : v % SYMBOLS;
+
+		temp_json = json_object_get(voice_json, "pos");
+		patch.pos[v] = temp_json && patch.words[v].size() > 0 ? clamp((int)json_integer_value(temp_json), 0, patch.words[v].size() - 1) : 0;
+	}
+
+	// the first voice is saved at the top level, the same as before there were voices
 	json_t *dataToJson() override
 	{
 		json_t *root_json = json_object();
 
 		json_object_set_new(root_json, "selection", json_integer(selection));
-		json_object_set_new(root_json, "pos", json_integer(pos));
+		json_object_set_new(root_json, "large", json_boolean(large));
+		json_object_set_new(root_json, "edit_voice", json_integer(edit_voice));
+		voiceToJson(0, root_json);
 
-		json_t *word_json = json_array();
-		for (auto s : word)
+		json_t *voices_json = json_array();
+		for (int v = 1; v < num_voices; ++v)
 		{
-			json_t *s_json = json_integer((int)s);
-			json_array_append_new(word_json, s_json);
+			json_t *voice_json = json_object();
+			voiceToJson(v, voice_json);
+			json_array_append_new(voices_json, voice_json);
 		}
-		json_object_set_new(root_json, "word", word_json);
+		json_object_set_new(root_json, "voices", voices_json);
 
-		for (int i = 0; i < 4; ++i)
+		return root_json;
+	}
+
+	// fromJson can run while the engine is running, for a preset load or a paste, so the patch is read into
+	// loaded and handed to the audio thread. a load it hasn't taken in yet is simply replaced
+	void dataFromJson(json_t *root_json) override
+	{
+		int state = LOAD_READY;
+		if (!load_state.compare_exchange_strong(state, LOAD_IDLE))
 		{
-			json_t *rules_json = json_array();
-			for (auto s : rules[i])
-			{
-				json_t *s_json = json_integer((int)s);
-				json_array_append_new(rules_json, s_json);
-			}
-			json_object_set_new(root_json, ("rule_" + std::to_string(i)).c_str(), rules_json);
+			while (load_state.load() == LOAD_APPLYING)
+				std::this_thread::yield();
 		}
+		if (!loaded)
+			loaded.reset(new Patch);
+		Patch &patch = *loaded;
 
-		return root_json;
+		json_t *temp_json = json_object_get(root_json, "large");
+		patch.large = temp_json && json_boolean_value(temp_json);
+
+		json_t *voices_json = json_object_get(root_json, "voices");
+		patch.num_voices = clamp(1 + (int)json_array_size(voices_json), 1, (int)MAX_VOICES);
+
+		voiceFromJson(patch, 0, root_json);
+		for (int v = 1; v < MAX_VOICES; ++v)
+			voiceFromJson(patch, v, v < patch.num_voices ? json_array_get(voices_json, v - 1) : NULL);
+
+		temp_json = json_object_get(root_json, "selection");
+		selection = temp_json ? clamp((int)json_integer_value(temp_json), 0, (patch.large ? LARGE_SYMBOLS : SYMBOLS) - 1) : 0;
+
+		temp_json = json_object_get(root_json, "edit_voice");
+		edit_voice = temp_json ? clamp((int)json_integer_value(temp_json), 0, patch.num_voices - 1) : 0;
+
+		load_state.store(LOAD_READY);
 	}
 
-	void dataFromJson(json_t *root_json) override
+	// audio thread. everything is replaced in one go as far as process() can tell. edits still queued up from
+	// the ui were made to the old state, so they are dropped
+	void applyLoad()
 	{
-		json_t *temp_json = json_object_get(root_json, "selection");
-		if (temp_json)
-			selection = json_integer_value(temp_json);
+		int state = LOAD_READY;
+		if (!load_state.compare_exchange_strong(state, LOAD_APPLYING))
+			return;
 
-		temp_json = json_object_get(root_json, "pos");
-		if (temp_json)
-			pos = json_integer_value(temp_json);
+		while (!commands.empty())
+			commands.shift();
 
-		temp_json = json_object_get(root_json, "word");
-		if (temp_json)
+		const Patch &patch = *loaded;
+		large = patch.large;
+		num_voices = patch.num_voices;
+		for (int v = 0; v < MAX_VOICES; ++v)
 		{
-			for (size_t i = 0; i < json_array_size(temp_json); ++i)
-				word.push_back(json_integer_value(json_array_get(temp_json, i)));
+			word_index[v] = 0;
+			words[v][0].assign(patch.words[v]);
+			for (int i = 0; i < LARGE_SYMBOLS; ++i)
+				rules[v][i] = patch.rules[v][i];
+			axiom[v] = patch.axiom[v];
+			pos[v] = patch.pos[v];
+			symbol_samples[v] = 0;
+			symbol_carry[v] = 0.f;
+			restartExpansion(v);
 		}
 
-		for (int i = 0; i < 4; ++i)
+		load_state.store(LOAD_IDLE);
+	}
+
+	//==================================================
+	RenickPackedWord<LARGE_WORD_MAX> &word(const int v)
+	{
+		return words[v][word_index[v]];
+	}
+
+	int getSymbols()
+	{
+		return large ? LARGE_SYMBOLS : SYMBOLS;
+	}
+
+	int getWordMax()
+	{
+		return large ? LARGE_WORD_MAX : WORD_MAX;
+	}
+
+	// the knobs set a to d, and the rest of the alphabet divides them, e to h by 2, i to l by 3 and m to p by 4.
+	// a polyphonic cv sets each voice's durations separately
+	float getDuration(const int v, const int s)
+	{
+		return params[s % 4].getValue() * abs(inputs[s % 4].getNormalPolyVoltage(10.f, v)) / 10.f / (s / 4 + 1);
+	}
+
+	// length of voice v's current symbol in samples, including the carry from the last one
+	int getSymbolSamples(const int v, const float sample_rate)
+	{
+		const float exact = dur[v] / (1000.f * fmax(0.01, params[TIME_PARAM].getValue())) * sample_rate + symbol_carry[v];
+		const int samples = std::max(static_cast<int>(exact), 1);
+		next_carry[v] = std::max(exact - samples, 0.f);
+		return samples;
+	}
+
+	void startSymbol(const int v, const float sample_rate)
+	{
+		dur[v] = getDuration(v, word(v)[pos[v]]);
+		symbol_samples[v] = remaining[v] = getSymbolSamples(v, sample_rate);
+	}
+
+	// picks up changes to the knobs and time partway through a symbol, keeping the samples already counted
+	void updateSymbol(const int v, const float sample_rate)
+	{
+		dur[v] = getDuration(v, word(v)[pos[v]]);
+		const int samples = getSymbolSamples(v, sample_rate);
+		remaining[v] += samples - symbol_samples[v];
+		symbol_samples[v] = samples;
+	}
+
+	void nextSymbol(const int v, const float sample_rate)
+	{
+		pos[v]++;
+		pos[v] %= word(v).size();
+
+		if (pos[v] == 0)
 		{
-			temp_json = json_object_get(root_json, ("rule_" + std::to_string(i)).c_str());
-			if (temp_json)
-			{
-				for (size_t j = 0; j < json_array_size(temp_json); ++j)
-					rules[i].push_back(json_integer_value(json_array_get(temp_json, j)));
-			}
+			updateWord(v);
 		}
+		symbol_carry[v] = next_carry[v];
+		startSymbol(v, sample_rate);
 	}
 
 	//==================================================
 	void process(const ProcessArgs &args) override
 	{
-		const float t = 1.0f / args.sampleRate;
+		if (load_state.load() == LOAD_READY)
+			applyLoad();
+		if (!commands.empty())
+			applyCommands();
 
-		if (word.size() == 0)
+		const bool control = control_divider.process();
+		for (int v = 0; v < num_voices; ++v)
 		{
-			pos = 0;
-			word.push_back(0);
-			dur = params[word[0]].getValue() * abs(inputs[word[0]].getNormalVoltage(10.f)) / 10.f;
+			if (word(v).size() == 0)
+			{
+				pos[v] = 0;
+				word(v).push_back(axiom[v]);
+				symbol_samples[v] = 0;
+				restartExpansion(v);
+			}
+
+			if (symbol_samples[v] == 0)
+				startSymbol(v, args.sampleRate);
+			else if (control)
+				updateSymbol(v, args.sampleRate);
+
+			if (!expanded[v])
+				expandSlice(v);
 		}
 
-		if (timer.process(t) >= dur / (1000.f * fmax(0.01, params[TIME_PARAM].getValue())))
+		for (int v = 0; v < num_voices; ++v)
+			--remaining[v];
+
+		const int pulse_length = std::max(static_cast<int>(1e-3f * args.sampleRate), 1);
+		outputs[GATE_OUTPUT].setChannels(num_voices);
+		for (int v = 0; v < num_voices; ++v)
 		{
-			pulse.trigger(1e-3f);
-			timer.reset();
+			if (remaining[v] <= 0)
+			{
+				pulse_samples[v] = pulse_length;
+				outputs[GATE_OUTPUT].setVoltage(10.f, v);
+				nextSymbol(v, args.sampleRate);
+			}
+			else if (pulse_samples[v] > 0 && --pulse_samples[v] == 0)
+			{
+				outputs[GATE_OUTPUT].setVoltage(0.f, v);
+			}
+		}
+	}
 
-			pos++;
-			pos %= word.size();
+	//==================================================
+	void clearVoice(const int v)
+	{
+		word(v).clear();
+		pos[v] = 0;
+		symbol_carry[v] = 0.f;
+		pulse_samples[v] = 0;
+		outputs[GATE_OUTPUT].setVoltage(0.f, v);
+	}
 
-			if (pos == 0)
+	//==================================================
+	void applyCommands()
+	{
+		// when a voice's rules or word change, its next generation has to be expanded again. the others carry on
+		while (!commands.empty())
+		{
+			const RenickCommand command = commands.shift();
+			switch (command.type)
 			{
-				updateWord();
+			case RenickCommand::ADD_LETTER:
+				if (rules[command.voice][command.rule].size() < RULE_MAX)
+					rules[command.voice][command.rule].push_back(command.letter);
+				restartExpansion(command.voice);
+				break;
+			case RenickCommand::CLEAR_RULE:
+				rules[command.voice][command.rule].clear();
+				restartExpansion(command.voice);
+				break;
+			case RenickCommand::RESET:
+				for (int i = 0; i < LARGE_SYMBOLS; ++i)
+					rules[command.voice][i].clear();
+				clearVoice(command.voice);
+				restartExpansion(command.voice);
+				break;
+			case RenickCommand::SET_LARGE:
+				large = command.letter;
+				for (int v = 0; v < MAX_VOICES; ++v)
+				{
+					axiom[v] %= getSymbols();
+					clearVoice(v);
+					restartExpansion(v);
+				}
+				break;
+			case RenickCommand::SET_VOICES:
+				for (int v = num_voices; v < command.voice; ++v)
+				{
+					clearVoice(v);
+					restartExpansion(v);
+				}
+				num_voices = command.voice;
+				break;
+			case RenickCommand::SET_AXIOM:
+				axiom[command.voice] = command.letter;
+				clearVoice(command.voice);
+				restartExpansion(command.voice);
+				break;
 			}
-			dur = params[word[pos]].getValue() * abs(inputs[word[pos]].getNormalVoltage(10.f)) / 10.f;
 		}
+	}
 
-		const float pulse_v = pulse.process(t) ? 10.0f : 0.0f;
-		if (outputs[GATE_OUTPUT].isConnected())
-			outputs[GATE_OUTPUT].setVoltage(pulse_v);
+	//==================================================
+	// the edits below come from the ui thread, so they are only queued up here.
+	// if the queue is full the edit is dropped, rather than ever waiting on the engine
+	void pushCommand(const RenickCommand &command)
+	{
+		if (!commands.full())
+			commands.push(command);
 	}
 
 	//==================================================
 	void reset()
 	{
-		word.clear();
-		for (int i = 0; i < 4; ++i)
-			rules[i].clear();
-		pos = 0;
-		timer.reset();
+		pushCommand({RenickCommand::RESET, edit_voice, 0, 0});
+	}
+
+	//==================================================
+	void setLarge(const bool large)
+	{
+		pushCommand({RenickCommand::SET_LARGE, 0, 0, large});
+	}
+
+	//==================================================
+	void setVoices(const int voices)
+	{
+		pushCommand({RenickCommand::SET_VOICES, voices, 0, 0});
 	}
 
 	//==================================================
-	void updateWord()
+	void setAxiom(const int letter_id)
 	{
-		std::vector<int> new_word;
-		for (auto x : word)
+		pushCommand({RenickCommand::SET_AXIOM, edit_voice, 0, letter_id});
+	}
+
+	//==================================================
+	void restartExpansion(const int v)
+	{
+		words[v][1 - word_index[v]].clear();
+		expand_pos[v] = 0;
+		expanded[v] = false;
+	}
+
+	//==================================================
+	// expands the next EXPAND_SLICE symbols of voice v's word into its next generation
+	void expandSlice(const int v)
+	{
+		const RenickPackedWord<LARGE_WORD_MAX> &word = words[v][word_index[v]];
+		RenickPackedWord<LARGE_WORD_MAX> &new_word = words[v][1 - word_index[v]];
+		const int word_max = getWordMax(), symbols = getSymbols();
+
+		for (int i = 0; i < EXPAND_SLICE && expand_pos[v] < word.size(); ++i, ++expand_pos[v])
 		{
-			for (auto r : rules[x])
+			for (auto r : rules[v][word[expand_pos[v]] % symbols])
 			{
-				if (new_word.size() >= WORD_MAX)
+				if (new_word.size() >= word_max)
 					break;
-				new_word.push_back(r);
+				new_word.push_back(r % symbols);
 			}
-			if (new_word.size() >= WORD_MAX)
+			if (new_word.size() >= word_max)
 				break;
 		}
-		word = new_word;
+
+		expanded[v] = expand_pos[v] >= word.size() || new_word.size() >= word_max;
+	}
+
+	//==================================================
+	void updateWord(const int v)
+	{
+		if (!expanded[v])
+			return;
+
+		word_index[v] = 1 - word_index[v];
+		restartExpansion(v);
 	}
 
 	//==================================================
@@ -178,31 +588,29 @@ struct Renick : Module
 	{
 		selection--;
 		if (selection < 0)
-			selection = 3;
+			selection = getSymbols() - 1;
 	}
 
 	//==================================================
 	void moveDown()
 	{
 		selection++;
-		selection %= 4;
+		selection %= getSymbols();
 	}
 
 	//==================================================
 	void clearSelection()
 	{
-		rules[selection].clear();
+		pushCommand({RenickCommand::CLEAR_RULE, edit_voice, selection, 0});
 	}
 
 	//==================================================
 	void addLetter(const int letter_id)
 	{
-		if (rules[selection].size() < RULE_MAX)
-		{
-			rules[selection].push_back(letter_id);
-		}
+		pushCommand({RenickCommand::ADD_LETTER, edit_voice, selection, letter_id});
 	}
 };
+
 //==================================================
 //==================================================
 //==================================================
@@ -240,32 +648,21 @@ struct RenickWordDisplay : Widget
 
 		nvgFontSize(args.vg, 10);
 		nvgFillColor(args.vg, PAT_PINK);
-		int i = 0;
-		for (auto s : module->word)
+
+		// large words are shown WORD_MAX symbols at a time, whichever page the position is on
+		const RenickPackedWord<Renick::LARGE_WORD_MAX> &word = module->word(module->edit_voice);
+		const int pos = module->pos[module->edit_voice];
+		const int start = pos / Renick::WORD_MAX * Renick::WORD_MAX;
+		const int end = std::min(start + Renick::WORD_MAX, word.size());
+		for (int i = start; i < end; ++i)
 		{
-			if (i == module->pos)
+			if (i == pos)
 				nvgFillColor(args.vg, nvgRGB(255, 0, 0));
 			else
 				nvgFillColor(args.vg, nvgRGB(0, 0, 0));
 
-			std::string S = "";
-			switch (s)
-			{
-			case 0:
-				S = "a";
-				break;
-			case 1:
-				S = "b";
-				break;
-			case 2:
-				S = "c";
-				break;
-			case 3:
-				S = "d";
-				break;
-			}
-			nvgText(args.vg, (i + 0.5) * x_unit, box.size.y * 0.85, S.c_str(), NULL);
-			++i;
+			const std::string S(1, 'a' + word[i]);
+			nvgText(args.vg, (i - start + 0.5) * x_unit, box.size.y * 0.85, S.c_str(), NULL);
 		}
 	}
 };
@@ -294,10 +691,16 @@ struct RenickRuleDisplay : Widget
 			letter_id = 3;
 	}
 
+	// in large mode the four rows show whichever four rules the selection is in
+	int getRule()
+	{
+		return module->selection / 4 * 4 + letter_id;
+	}
+
 	void onButton(const event::Button &e) override
 	{
 		if (e.action == GLFW_PRESS)
-			module->selection = letter_id;
+			module->selection = getRule();
 	}
 
 	void draw(const DrawArgs &args) override
@@ -310,35 +713,23 @@ struct RenickRuleDisplay : Widget
 		nvgRect(args.vg, 0, 0, box.size.x, box.size.y);
 		nvgFill(args.vg);
 
-		nvgStrokeColor(args.vg, module->selection == letter_id ? PAT_PINK : nvgRGB(0, 0, 0));
+		const int rule = getRule();
+
+		nvgStrokeColor(args.vg, module->selection == rule ? PAT_PINK : nvgRGB(0, 0, 0));
 		nvgBeginPath(args.vg);
 		nvgRect(args.vg, 0, 0, box.size.x, box.size.y);
 		nvgStroke(args.vg);
 
-		if (module->rules[letter_id].size() == 0)
+		const RenickString<Renick::RULE_MAX> &rules = module->rules[module->edit_voice][rule];
+		if (rules.size() == 0)
 			return;
 
 		nvgFontSize(args.vg, 10);
 		nvgFillColor(args.vg, PAT_PINK);
 		int i = 0;
-		for (auto s : module->rules[letter_id])
+		for (auto s : rules)
 		{
-			std::string S = "";
-			switch (s)
-			{
-			case 0:
-				S = "a";
-				break;
-			case 1:
-				S = "b";
-				break;
-			case 2:
-				S = "c";
-				break;
-			case 3:
-				S = "d";
-				break;
-			}
+			const std::string S(1, 'a' + s);
 
 			nvgText(args.vg, (i + 0.5) * x_unit, box.size.y * 0.85, S.c_str(), NULL);
 			++i;
@@ -359,13 +750,13 @@ struct RenickButton : SvgWidget
 		this->module = module;
 	}
 
-	virtual void onLeftClick() {}
+	virtual void onLeftClick(const int mods) {}
 
 	void onButton(const event::Button &e) override
 	{
 		if (e.action == GLFW_PRESS)
 		{
-			onLeftClick();
+			onLeftClick(e.mods);
 			setSvg(pressed_svg);
 		}
 		else
@@ -385,7 +776,7 @@ struct RenickUpButton : RenickButton
 		setSvg(regular_svg);
 	}
 
-	void onLeftClick() override
+	void onLeftClick(const int mods) override
 	{
 		module->moveUp();
 	}
@@ -401,7 +792,7 @@ struct RenickDownButton : RenickButton
 		setSvg(regular_svg);
 	}
 
-	void onLeftClick() override
+	void onLeftClick(const int mods) override
 	{
 		module->moveDown();
 	}
@@ -417,7 +808,7 @@ struct RenickClearButton : RenickButton
 		setSvg(regular_svg);
 	}
 
-	void onLeftClick() override
+	void onLeftClick(const int mods) override
 	{
 		module->clearSelection();
 	}
@@ -433,7 +824,7 @@ struct RenickResetButton : RenickButton
 		setSvg(regular_svg);
 	}
 
-	void onLeftClick() override
+	void onLeftClick(const int mods) override
 	{
 		module->reset();
 	}
@@ -462,9 +853,18 @@ struct RenickLetterButton : RenickButton
 		setSvg(regular_svg);
 	}
 
-	void onLeftClick() override
+	// in large mode, shift, ctrl, or both pick from e to h, i to l, or m to p instead
+	void onLeftClick(const int mods) override
 	{
-		module->addLetter(letter_id);
+		int bank = 0;
+		if (module->large)
+		{
+			if (mods & GLFW_MOD_SHIFT)
+				bank += 1;
+			if (mods & RACK_MOD_CTRL)
+				bank += 2;
+		}
+		module->addLetter(letter_id + 4 * bank);
 	}
 };
 
@@ -518,6 +918,117 @@ struct RenickWidget : ModuleWidget
 		// mm2px(Vec(35.56, 4.016))
 		addChild(new RenickRuleDisplay(mm2px(Vec(20.32, 104.406)), module, "d"));
 	}
+
+	struct LargeItem : MenuItem
+	{
+		Renick *module;
+
+		void onAction(const event::Action &e) override
+		{
+			if (module->large)
+				module->selection %= Renick::SYMBOLS;
+			module->setLarge(!module->large);
+		}
+	};
+
+	struct VoicesItem : MenuItem
+	{
+		Renick *module;
+		int voices;
+
+		void onAction(const event::Action &e) override
+		{
+			module->edit_voice = std::min(module->edit_voice, voices - 1);
+			module->setVoices(voices);
+		}
+	};
+
+	struct EditVoiceItem : MenuItem
+	{
+		Renick *module;
+		int voice;
+
+		void onAction(const event::Action &e) override
+		{
+			module->edit_voice = voice;
+		}
+	};
+
+	struct AxiomItem : MenuItem
+	{
+		Renick *module;
+		int letter_id;
+
+		void onAction(const event::Action &e) override
+		{
+			module->setAxiom(letter_id);
+		}
+	};
+
+	struct EditVoiceMenuItem : MenuItem
+	{
+		Renick *module;
+
+		Menu *createChildMenu() override
+		{
+			Menu *menu = new Menu;
+			for (int v = 0; v < module->num_voices; ++v)
+			{
+				EditVoiceItem *item = createMenuItem<EditVoiceItem>(string::f("%d", v + 1), CHECKMARK(module->edit_voice == v));
+				item->module = module;
+				item->voice = v;
+				menu->addChild(item);
+			}
+			return menu;
+		}
+	};
+
+	struct AxiomMenuItem : MenuItem
+	{
+		Renick *module;
+
+		Menu *createChildMenu() override
+		{
+			Menu *menu = new Menu;
+			for (int i = 0; i < module->getSymbols(); ++i)
+			{
+				AxiomItem *item = createMenuItem<AxiomItem>(std::string(1, 'a' + i), CHECKMARK(module->axiom[module->edit_voice] == i));
+				item->module = module;
+				item->letter_id = i;
+				menu->addChild(item);
+			}
+			return menu;
+		}
+	};
+
+	void appendContextMenu(Menu *menu) override
+	{
+		Renick *module = dynamic_cast<Renick *>(this->module);
+
+		menu->addChild(new MenuEntry);
+		LargeItem *large_item = createMenuItem<LargeItem>("Large words (16 symbols)", CHECKMARK(module->large));
+		large_item->module = module;
+		menu->addChild(large_item);
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Voices"));
+		for (int n : {1, 2, 3, 4, 6, 8, 12, 16})
+		{
+			VoicesItem *item = createMenuItem<VoicesItem>(string::f("%d", n), CHECKMARK(module->num_voices == n));
+			item->module = module;
+			item->voices = n;
+			menu->addChild(item);
+		}
+
+		menu->addChild(new MenuEntry);
+		EditVoiceMenuItem *edit_item = createMenuItem<EditVoiceMenuItem>(string::f("Edit voice: %d", module->edit_voice + 1), RIGHT_ARROW);
+		edit_item->module = module;
+		menu->addChild(edit_item);
+
+		AxiomMenuItem *axiom_item = createMenuItem<AxiomMenuItem>(string::f("Axiom: %c", 'a' + module->axiom[module->edit_voice]), RIGHT_ARROW);
+		axiom_item->module = module;
+		menu->addChild(axiom_item);
+	}
 };
 
 Model *modelRenick = createModel<Renick, RenickWidget>("renick");
\ No newline at end of file
@@ -1,6 +1,27 @@
 #include "plugin.hpp"
 #include "common.hpp"
 
+// a channel of the poly output ticks mul times every div beats
+struct TimothyRatio
+{
+	int mul, div;
+
+	std::string getName() const
+	{
+		if (mul == div)
+			return "1";
+		if (div == 1)
+			return string::f("x%d", mul);
+		if (mul == 1)
+			return string::f("/%d", div);
+		return string::f("%d/%d", mul, div);
+	}
+};
+
+static const TimothyRatio TIMOTHY_RATIOS[] = {
+	{8, 1}, {7, 1}, {6, 1}, {5, 1}, {4, 1}, {3, 1}, {2, 1}, {3, 2}, {4, 3}, {1, 1}, {3, 4}, {2, 3}, {1, 2}, {1, 3}, {1, 4}, {1, 5}, {1, 6}, {1, 7}, {1, 8}, {1, 12}, {1, 16}};
+static const int NUM_TIMOTHY_RATIOS = sizeof(TIMOTHY_RATIOS) / sizeof(TIMOTHY_RATIOS[0]);
+
 struct Timothy : Module
 {
 	enum ParamIds
@@ -22,6 +43,7 @@ struct Timothy : Module
 		MUL_HALF_INPUT,
 		MUL_2_INPUT,
 		MUL_4_INPUT,
+		CLOCK_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds
@@ -32,6 +54,7 @@ struct Timothy : Module
 		_4_OUTPUT,
 		_8_OUTPUT,
 		_16_OUTPUT,
+		POLY_OUTPUT,
 		NUM_OUTPUTS
 	};
 	enum LightIds
@@ -44,17 +67,57 @@ struct Timothy : Module
 		NUM_LIGHTS
 	};
 
-	dsp::Timer timer, reset_timer;
-	dsp::PulseGenerator pulse;
+	// the clock is a 64 bit phase accumulator, where a full turn (an overflow) is one beat.
+	// the step holds the period to about 1e-16 of a sample, so it doesn't drift against the audio
+	// clock however long it runs, and the leftover phase carries periods that aren't a whole number of samples
+	uint64_t phase = 0, phase_step = 0;
+	float step_bpm = 0.f, step_sample_rate = 0.f;
+
+	dsp::ClockDivider control_divider;
 	dsp::SchmittTrigger mul_triggers[4];
 	dsp::SchmittTrigger reset_trigger;
 	bool mul_toggles[4] = {false, false, false, false};
 	int num_toggles = 0;
 	float muls[4] = {0.25f, 0.5f, 2.f, 4.f};
 	float mul = 1.f;
-	float dur = 1.f;
-	bool running = true, reset_timer_active = false;
+	bool running = true;
 	int count = 0;
+	int reset_samples = 0, pulse_samples = 0;
+
+	// following a clock into CLOCK_INPUT, one edge per beat. clock_samples counts samples since the
+	// last edge (-1 before the first one), and stops at CLOCK_MAX_SAMPLES so a stopped clock can't overflow it.
+	// it's a phase locked loop. on every edge that should land on a beat, the phase error is measured, a
+	// fraction CLOCK_GAIN of it is spread over the next period through clock_correction, a fraction
+	// CLOCK_RATE_GAIN of it goes into clock_period, and CLOCK_DRIFT_GAIN of it into clock_drift, how fast
+	// the period is changing, so a tempo ramp is followed without lagging. the beats pull into line with the
+	// edges without jumping, and the jitter of single edges mostly averages away. the loop needs a good period to start
+	// from, so the first CLOCK_AVERAGE periods between edges are averaged into clock_period, with the
+	// gain starting high and settling as the average fills. that starts over when two periods in a row
+	// are further off the average than the jitter explains (clock_spread, the average deviation), which is
+	// a tempo change. all of it is O(1) per edge and a counter per sample
+	static const int CLOCK_AVERAGE = 16;
+	static const int CLOCK_MAX_SAMPLES = 1 << 30;
+	static constexpr double CLOCK_GAIN = 0.125;
+	static constexpr double CLOCK_RATE_GAIN = 0.01;
+	static constexpr double CLOCK_DRIFT_GAIN = 0.0002;
+	dsp::SchmittTrigger clock_trigger;
+	int clock_samples = -1;
+	int clock_count = 0, clock_changes = 0;
+	int clock_edges = 0;
+	double clock_period = 0.0, clock_drift = 0.0, clock_spread = 0.0, clock_correction = 0.0;
+	bool clock_sync = false;
+
+	// the poly output, where channel c ticks poly_ratios[c].mul times every poly_ratios[c].div beats.
+	// every channel is worked out from the master phase, 4 at a time. position is how far through its
+	// cycle of div beats a channel is, in 1/65536ths of a beat, which keeps it a whole number that float
+	// holds exactly. a channel ticks when position passes its next threshold, which then moves on by
+	// step = div * 65536 / mul. poly_beats counts master beats, so the lanes can be rebuilt in line with the clock
+	static const int MAX_POLY = 16;
+	int poly_channels = 8;
+	TimothyRatio poly_ratios[MAX_POLY] = {{1, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5}, {1, 6}, {1, 7}, {1, 8}, {2, 1}, {3, 1}, {4, 1}, {5, 1}, {6, 1}, {7, 1}, {8, 1}, {1, 16}};
+	uint32_t poly_beats = 0;
+	simd::float_4 poly_div[4], poly_step[4], poly_count[4], poly_next[4], poly_pulse[4];
+	bool update_poly = true;
 
 	Timothy()
 	{
@@ -66,62 +129,227 @@ struct Timothy : Module
 		configParam(MUL_HALF_PARAM, 0.f, 1.f, 0.f, "Multiplies BPM by 1/2");
 		configParam(MUL_2_PARAM, 0.f, 1.f, 0.f, "Multiplies BPM by 2");
 		configParam(MUL_4_PARAM, 0.f, 1.f, 0.f, "Multiplies BPM by 4");
+
+		control_divider.setDivision(16);
+	}
+
+	json_t *dataToJson() override
+	{
+		json_t *root_json = json_object();
+
+		json_t *ratios_json = json_array();
+		for (int c = 0; c < poly_channels; ++c)
+		{
+			json_t *ratio_json = json_array();
+			json_array_append_new(ratio_json, json_integer(poly_ratios[c].mul));
+			json_array_append_new(ratio_json, json_integer(poly_ratios[c].div));
+			json_array_append_new(ratios_json, ratio_json);
+		}
+		json_object_set_new(root_json, "poly_ratios", ratios_json);
+
+		return root_json;
+	}
+
+	void dataFromJson(json_t *root_json) override
+	{
+		json_t *ratios_json = json_object_get(root_json, "poly_ratios");
+		if (ratios_json)
+		{
+			poly_channels = clamp((int)json_array_size(ratios_json), 1, (int)MAX_POLY);
+			for (int c = 0; c < poly_channels; ++c)
+			{
+				json_t *ratio_json = json_array_get(ratios_json, c);
+				poly_ratios[c].mul = clamp((int)json_integer_value(json_array_get(ratio_json, 0)), 1, 16);
+				poly_ratios[c].div = clamp((int)json_integer_value(json_array_get(ratio_json, 1)), 1, 16);
+			}
+			update_poly = true;
+		}
 	}
 
-	float getBPS()
+	float getBPM()
 	{
 		if (inputs[BPM_INPUT].isConnected())
-			return 60.f / rescale(abs(inputs[BPM_INPUT].getVoltage()), 0.f, 10.f, 1.f, 120.f * 16.f);
+			return rescale(abs(inputs[BPM_INPUT].getVoltage()), 0.f, 10.f, 1.f, 120.f * 16.f);
 		else
-			return 60.f / params[BPM_PARAM].getValue();
+			return params[BPM_PARAM].getValue();
 	}
 
-	void process(const ProcessArgs &args) override
+	// the period is worked out in double from the bpm itself, rather than from the rounded float duration
+	void setTempo(float bpm, float sample_rate)
 	{
+		if (bpm == step_bpm && sample_rate == step_sample_rate)
+			return;
+		step_bpm = bpm;
+		step_sample_rate = sample_rate;
 
-		bool reset = false;
-		reset = params[RESET_PARAM].getValue() > 0.5;
-		if (inputs[RESET_INPUT].isConnected())
-			if (reset_trigger.process(rescale(inputs[RESET_INPUT].getVoltage(), 0.1f, 2.f, 0.f, 1.f)))
-				reset = true;
+		const double samples = 60.0 * sample_rate / bpm;
+		if (samples <= 1.0)
+			phase_step = UINT64_MAX;
+		else
+			phase_step = static_cast<uint64_t>(std::ldexp(1.0, 64) / samples);
+	}
+
+	float getMul()
+	{
+		return num_toggles != 0 ? mul : 1.f;
+	}
+
+	// sets the phase step from the followed clock rather than the bpm
+	void setClockStep()
+	{
+		phase_step = static_cast<uint64_t>(std::ldexp(1.0, 64) * std::max(getMul() / clock_period - clock_correction, 0.0));
+	}
+
+	void followClock()
+	{
+		if (clock_samples >= 0 && clock_samples < CLOCK_MAX_SAMPLES)
+			++clock_samples;
+		if (!clock_trigger.process(rescale(inputs[CLOCK_INPUT].getVoltage(), 0.1f, 2.f, 0.f, 1.f)))
+			return;
+
+		// the first edge only starts the count
+		if (clock_samples < 0)
+		{
+			clock_samples = 0;
+			return;
+		}
+
+		const int period = clock_samples;
+		clock_samples = 0;
+		if (period < 2)
+			return;
 
-		if (reset)
+		// start again if the tempo jumps, and line the beat straight up with this edge
+		if (clock_count == 0 || period * 2 < clock_period || period > clock_period * 2)
 		{
-			timer.reset();
-			count = 0;
-			for (auto l : lights)
-				l.setBrightness(0.f);
-			reset_timer.reset();
-			reset_timer_active = true;
+			clock_count = 0;
+			clock_changes = 0;
+			clock_period = 0.0;
+			clock_drift = 0.0;
+			clock_spread = 0.0;
+			clock_sync = true;
 		}
 
-		if (reset_timer_active)
+		// two periods in a row off the same way by more than the jitter explains means the tempo has moved
+		const double deviation = period - clock_period;
+		if (clock_count == CLOCK_AVERAGE && std::abs(deviation) > 4.0 * clock_spread + 0.002 * clock_period)
 		{
-			if (reset_timer.process(1.f / args.sampleRate) >= 0.001)
+			clock_changes = deviation > 0.0 ? std::max(clock_changes, 0) + 1 : std::min(clock_changes, 0) - 1;
+			if (std::abs(clock_changes) == 2)
 			{
-				reset_timer_active = false;
+				clock_count = 0;
+				clock_drift = 0.0;
 			}
-			else
+		}
+		else
+		{
+			clock_changes = 0;
+			if (clock_count > 1)
+				clock_spread += (std::abs(deviation) - clock_spread) / clock_count;
+		}
+
+		if (clock_count < CLOCK_AVERAGE)
+		{
+			++clock_count;
+			clock_period += (period - clock_period) / clock_count;
+		}
+
+		// with a multiplier under 1 only every span-th edge lands on a beat
+		const int span = getMul() < 1.f ? static_cast<int>(1.f / getMul()) : 1;
+		if (clock_sync)
+		{
+			clock_sync = false;
+			clock_edges = 0;
+			clock_correction = 0.0;
+			setClockStep();
+			phase = 0 - phase_step; // so the beat fires on this sample
+			return;
+		}
+
+		if (++clock_edges % span == 0)
+		{
+			// how far the phase is, in turns, from wrapping halfway through this sample's step, which is a beat right on the edge
+			const double error = static_cast<int64_t>(phase + phase_step / 2) * std::ldexp(1.0, -64);
+			const double gain = clock_count * CLOCK_GAIN < 1.0 ? 1.0 / clock_count : CLOCK_GAIN;
+			clock_correction = gain * error / (clock_period * span);
+			if (clock_count == CLOCK_AVERAGE)
 			{
-				return;
+				const double early = error * clock_period / (getMul() * span);
+				clock_drift += CLOCK_DRIFT_GAIN * early;
+				clock_period += CLOCK_RATE_GAIN * early + clock_drift;
 			}
 		}
+		setClockStep();
+	}
 
-		num_toggles = 0;
+	// position of the master clock within the current beat, in 1/65536ths
+	float getBeatPosition()
+	{
+		return static_cast<float>(phase >> 48);
+	}
+
+	// rebuilds the poly lanes from poly_ratios, lining each channel's cycle up with the master beat count
+	void updatePoly()
+	{
+		update_poly = false;
+
+		float div[MAX_POLY], step[MAX_POLY], count[MAX_POLY], next[MAX_POLY];
+		const float position = getBeatPosition();
+		for (int c = 0; c < MAX_POLY; ++c)
+		{
+			div[c] = poly_ratios[c].div;
+			step[c] = poly_ratios[c].div * 65536.f / poly_ratios[c].mul;
+			count[c] = poly_beats % poly_ratios[c].div;
+			next[c] = (std::floor((count[c] * 65536.f + position) / step[c]) + 1.f) * step[c];
+		}
 		for (int i = 0; i < 4; ++i)
 		{
-			const bool last_toggle = mul_toggles[i];
+			poly_div[i] = simd::float_4::load(div + i * 4);
+			poly_step[i] = simd::float_4::load(step + i * 4);
+			poly_count[i] = simd::float_4::load(count + i * 4);
+			poly_next[i] = simd::float_4::load(next + i * 4);
+			poly_pulse[i] = 0.f;
+		}
+	}
 
-			mul_toggles[i] = params[MUL_QUARTER_PARAM + i].getValue() > 0.5;
-			if (inputs[MUL_QUARTER_INPUT + i].isConnected())
+	// one pass over every poly channel. beat is true on samples where the master clock ticked
+	void processPoly(bool beat, float sample_time)
+	{
+		if (update_poly)
+			updatePoly();
+
+		const float position = getBeatPosition();
+		outputs[POLY_OUTPUT].setChannels(poly_channels);
+		for (int i = 0; i < poly_channels; i += 4)
+		{
+			simd::float_4 &count = poly_count[i / 4];
+			simd::float_4 &next = poly_next[i / 4];
+
+			// when a channel comes round to the start of its cycle, its first tick is due straight away
+			if (beat)
 			{
-				if (mul_triggers[i].process(rescale(inputs[MUL_QUARTER_INPUT + i].getVoltage(), 0.1f, 2.f, 0.f, 1.f)))
-				{
-					mul_toggles[i] = !mul_toggles[i];
-					params[MUL_QUARTER_PARAM + i].setValue(mul_toggles[i] ? 1.f : 0.f);
-				}
+				count += 1.f;
+				const simd::float_4 wrap = count >= poly_div[i / 4];
+				count = simd::ifelse(wrap, 0.f, count);
+				next = simd::ifelse(wrap, 0.f, next);
 			}
 
+			const simd::float_4 tick = count * 65536.f + position >= next;
+			next = simd::ifelse(tick, next + poly_step[i / 4], next);
+			poly_pulse[i / 4] = simd::ifelse(tick, 1e-3f, poly_pulse[i / 4] - sample_time);
+			outputs[POLY_OUTPUT].setVoltageSimd(simd::ifelse(poly_pulse[i / 4] > 0.f, 10.f, 0.f), i);
+		}
+	}
+
+	// selects multiplier i and switches the others off, or drops back to no multiplier if i was switched off
+	void scanMuls()
+	{
+		num_toggles = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			const bool last_toggle = mul_toggles[i];
+			mul_toggles[i] = params[MUL_QUARTER_PARAM + i].getValue() > 0.5;
+
 			if (mul_toggles[i])
 			{
 				++num_toggles;
@@ -139,49 +367,133 @@ struct Timothy : Module
 				}
 			}
 		}
+	}
+
+	// the knobs, buttons and bpm cv only get read every control_divider samples
+	void updateControls(float sample_rate)
+	{
+		if (params[RESET_PARAM].getValue() > 0.5)
+			reset(sample_rate);
+
+		scanMuls();
 
+		// the step is kept up to date while stopped too, so switching on starts at the right tempo
 		running = params[ON_PARAM].getValue() > 0.5;
-		if (running)
-		{
-			dur = getBPS();
+		const float bpm = clock_period > 0.0 ? 60.f * sample_rate / clock_period : getBPM();
+		if (running && outputs[BPM_OUTPUT].isConnected())
+			outputs[BPM_OUTPUT].setVoltage(rescale(60.f / bpm, 60.f / 120.f * 16.f, 60.f / 1.f, 0.f, 10.f));
+
+		if (clock_period > 0.0)
+			setClockStep();
+		else
+			setTempo(bpm * getMul(), sample_rate);
+	}
+
+	// restarts the clock, and holds it for 1ms so whatever is reset alongside has time to catch up
+	void reset(float sample_rate)
+	{
+		phase = 0;
+		count = 0;
+		poly_beats = 0;
+		update_poly = true;
+		for (auto &l : lights)
+			l.setBrightness(0.f);
+		reset_samples = std::max(static_cast<int>(1e-3f * sample_rate), 1);
+		clock_sync = true;
+	}
+
+	void beat(float sample_rate)
+	{
+		++poly_beats;
 
-			if (outputs[BPM_OUTPUT].isConnected())
-				outputs[BPM_OUTPUT].setVoltage(rescale(dur, 60.f / 120.f * 16.f, 60.f / 1.f, 0.f, 10.f));
+		lights[_1_LIGHT].setBrightness(lights[_1_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
+		if (count % 2 == 0)
+			lights[_2_LIGHT].setBrightness(lights[_2_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
+		if (count % 4 == 0)
+			lights[_4_LIGHT].setBrightness(lights[_4_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
+		if (count % 8 == 0)
+			lights[_8_LIGHT].setBrightness(lights[_8_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
+		if (count % 16 == 0)
+			lights[_16_LIGHT].setBrightness(lights[_16_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
 
-			if (num_toggles != 0)
-				dur /= mul;
+		count = (count + 1) % 16;
 
-			const float r = 1.f / args.sampleRate;
+		// outputs are only written when a pulse starts or ends, in between they hold their voltage
+		pulse_samples = std::max(static_cast<int>(1e-3f * sample_rate), 1);
+		setPulse(10.f);
+	}
+
+	void setPulse(float v)
+	{
+		outputs[_1_OUTPUT].setVoltage(v);
+		if (count % 2 == 0)
+			outputs[_2_OUTPUT].setVoltage(v);
+		if (count % 4 == 0)
+			outputs[_4_OUTPUT].setVoltage(v);
+		if (count % 8 == 0)
+			outputs[_8_OUTPUT].setVoltage(v);
+		if (count % 16 == 0)
+			outputs[_16_OUTPUT].setVoltage(v);
+	}
+
+	void process(const ProcessArgs &args) override
+	{
+		// step_sample_rate is only 0 until the tempo has been set once, so the first sample doesn't wait for the divider
+		if (control_divider.process() || step_sample_rate == 0.f)
+			updateControls(args.sampleRate);
+
+		// trigger inputs stay at audio rate, but only the ones that are patched
+		if (inputs[RESET_INPUT].isConnected())
+			if (reset_trigger.process(rescale(inputs[RESET_INPUT].getVoltage(), 0.1f, 2.f, 0.f, 1.f)))
+				reset(args.sampleRate);
 
-			if (timer.process(r) >= dur)
+		for (int i = 0; i < 4; ++i)
+		{
+			if (inputs[MUL_QUARTER_INPUT + i].isConnected())
 			{
-				timer.reset();
-				pulse.trigger(1e-3f);
-
-				lights[_1_LIGHT].setBrightness(lights[_1_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
-				if (count % 2 == 0)
-					lights[_2_LIGHT].setBrightness(lights[_2_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
-				if (count % 4 == 0)
-					lights[_4_LIGHT].setBrightness(lights[_4_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
-				if (count % 8 == 0)
-					lights[_8_LIGHT].setBrightness(lights[_8_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
-				if (count % 16 == 0)
-					lights[_16_LIGHT].setBrightness(lights[_16_LIGHT].getBrightness() > 0.5 ? 0.f : 1.f);
-
-				count = (count + 1) % 16;
+				if (mul_triggers[i].process(rescale(inputs[MUL_QUARTER_INPUT + i].getVoltage(), 0.1f, 2.f, 0.f, 1.f)))
+				{
+					params[MUL_QUARTER_PARAM + i].setValue(mul_toggles[i] ? 0.f : 1.f);
+					updateControls(args.sampleRate);
+				}
 			}
+		}
+
+		// the clock is followed even while a reset is held, so a reset and an edge on the same sample line up
+		if (inputs[CLOCK_INPUT].isConnected())
+		{
+			followClock();
+		}
+		else if (clock_samples >= 0)
+		{
+			clock_samples = -1;
+			clock_count = 0;
+			clock_period = 0.0;
+			step_bpm = 0.f;
+		}
+
+		if (reset_samples > 0)
+		{
+			--reset_samples;
+			return;
+		}
 
-			const float pulse_v = pulse.process(r) ? 10.0f : 0.0f;
+		if (running)
+		{
+			const uint64_t last_phase = phase;
+			phase += phase_step;
+
+			const bool is_beat = phase < last_phase;
+			if (is_beat)
+				beat(args.sampleRate);
+			else if (pulse_samples > 0 && --pulse_samples == 0)
+				setPulse(0.f);
 
-			outputs[_1_OUTPUT].setVoltage(pulse_v);
-			if (count % 2 == 0)
-				outputs[_2_OUTPUT].setVoltage(pulse_v);
-			if (count % 4 == 0)
-				outputs[_4_OUTPUT].setVoltage(pulse_v);
-			if (count % 8 == 0)
-				outputs[_8_OUTPUT].setVoltage(pulse_v);
-			if (count % 16 == 0)
-				outputs[_16_OUTPUT].setVoltage(pulse_v);
+			// the lanes are rebuilt when the cable goes back in, so they pick up where the clock is
+			if (outputs[POLY_OUTPUT].isConnected())
+				processPoly(is_beat, args.sampleTime);
+			else
+				update_poly = true;
 		}
 	}
 };
@@ -220,6 +532,82 @@ struct TimothyWidget : ModuleWidget
 		addChild(createLightCentered<SmallLight<PinkLight>>(mm2px(Vec(15.24, 62.242)), module, Timothy::_4_LIGHT));
 		addChild(createLightCentered<SmallLight<PinkLight>>(mm2px(Vec(25.4, 62.242)), module, Timothy::_8_LIGHT));
 		addChild(createLightCentered<SmallLight<PinkLight>>(mm2px(Vec(35.56, 62.242)), module, Timothy::_16_LIGHT));
+
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(45.72, 24.094)), module, Timothy::CLOCK_INPUT));
+
+		addOutput(createOutputCentered<PJ301MOutputPort>(mm2px(Vec(45.72, 56.219)), module, Timothy::POLY_OUTPUT));
+	}
+
+	struct PolyChannelsItem : MenuItem
+	{
+		Timothy *module;
+		int channels;
+
+		void onAction(const event::Action &e) override
+		{
+			module->poly_channels = channels;
+			module->update_poly = true;
+		}
+	};
+
+	struct PolyRatioItem : MenuItem
+	{
+		Timothy *module;
+		int channel;
+		TimothyRatio ratio;
+
+		void onAction(const event::Action &e) override
+		{
+			module->poly_ratios[channel] = ratio;
+			module->update_poly = true;
+		}
+	};
+
+	struct PolyChannelItem : MenuItem
+	{
+		Timothy *module;
+		int channel;
+
+		Menu *createChildMenu() override
+		{
+			Menu *menu = new Menu;
+			for (int i = 0; i < NUM_TIMOTHY_RATIOS; ++i)
+			{
+				const TimothyRatio &ratio = TIMOTHY_RATIOS[i];
+				const TimothyRatio &current = module->poly_ratios[channel];
+				PolyRatioItem *item = createMenuItem<PolyRatioItem>(ratio.getName(), CHECKMARK(current.mul == ratio.mul && current.div == ratio.div));
+				item->module = module;
+				item->channel = channel;
+				item->ratio = ratio;
+				menu->addChild(item);
+			}
+			return menu;
+		}
+	};
+
+	void appendContextMenu(Menu *menu) override
+	{
+		Timothy *module = dynamic_cast<Timothy *>(this->module);
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Poly channels"));
+		for (int n : {1, 2, 4, 8, 12, 16})
+		{
+			PolyChannelsItem *item = createMenuItem<PolyChannelsItem>(string::f("%d", n), CHECKMARK(module->poly_channels == n));
+			item->module = module;
+			item->channels = n;
+			menu->addChild(item);
+		}
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(createMenuLabel("Poly ratios"));
+		for (int c = 0; c < module->poly_channels; ++c)
+		{
+			PolyChannelItem *item = createMenuItem<PolyChannelItem>(string::f("Channel %d: %s", c + 1, module->poly_ratios[c].getName().c_str()), RIGHT_ARROW);
+			item->module = module;
+			item->channel = c;
+			menu->addChild(item);
+		}
 	}
 };
 
@@ -0,0 +1,83 @@
+// cost per sample of chance, as it would run with many of them in a generative patch. 100 instances are
+// processed side by side, all four outputs patched, for each kind of gate input below. held is a gate that
+// stays high, clock a 1ms trigger 8 times a second, and noise changes on every sample, the worst case.
+// the poly runs have 16 channels, with each channel's clock a little behind the one before
+#include "../src/chance.cpp"
+#include <chrono>
+#include <cstdio>
+
+static const int INSTANCES = 100;
+static const int SAMPLES = 48000;
+static const int RUNS = 5;
+
+enum Gate
+{
+	GATE_HELD,
+	GATE_CLOCK,
+	GATE_NOISE
+};
+
+static float gateVoltage(int gate, int n, int c)
+{
+	switch (gate)
+	{
+	case GATE_HELD:
+		return 10.f;
+	case GATE_CLOCK:
+		return (n + c * 50) % 6000 < 48 ? 10.f : 0.f;
+	default:
+		return random::uniform() * 10.f;
+	}
+}
+
+static double run(std::vector<Chance> &chances, int gate, int channels)
+{
+	Module::ProcessArgs args;
+	args.sampleRate = 48000.f;
+	args.sampleTime = 1.f / 48000.f;
+
+	// the gate is worked out ahead of time, so only chance is timed
+	std::vector<float> gates(SAMPLES * channels);
+	for (int n = 0; n < SAMPLES; ++n)
+		for (int c = 0; c < channels; ++c)
+			gates[n * channels + c] = gateVoltage(gate, n, c);
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int n = 0; n < SAMPLES; ++n)
+	{
+		for (Chance &chance : chances)
+		{
+			std::memcpy(chance.inputs[Chance::GATE_INPUT].voltages, &gates[n * channels], channels * sizeof(float));
+			chance.process(args);
+		}
+	}
+	const auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / (double(SAMPLES) * INSTANCES);
+}
+
+int main()
+{
+	const char *gate_names[] = {"held", "clock", "noise"};
+	printf("%-8s %8s %10s\n", "gate", "channels", "ns/sample");
+	for (int channels : {1, 16})
+	{
+		for (int gate = GATE_HELD; gate <= GATE_NOISE; ++gate)
+		{
+			std::vector<Chance> chances(INSTANCES);
+			for (Chance &chance : chances)
+			{
+				chance.inputs[Chance::GATE_INPUT].setChannels(channels);
+				for (int i = 0; i < 4; ++i)
+					chance.outputs[i].setChannels(1);
+			}
+
+			run(chances, gate, channels);
+			double ns = run(chances, gate, channels);
+			for (int i = 1; i < RUNS; ++i)
+				ns = std::min(ns, run(chances, gate, channels));
+			printf("%-8s %8d %10.2f\n", gate_names[gate], channels, ns);
+		}
+	}
+	printf("ns per instance per sample, %d instances, best of %d runs of %d samples\n", INSTANCES, RUNS, SAMPLES);
+	return 0;
+}
@@ -0,0 +1,75 @@
+// cost per sample of pete's playback, for each interpolation mode, storage format and channel count.
+// pete records 2 seconds of noise, is switched on, and plays the loop back at a fractional speed
+// so every mode has to interpolate. "off" is the cost of recording and passing the input through.
+// each figure is the best of several runs, to keep other load on the machine out of it
+#include "../src/pete.cpp"
+#include <chrono>
+#include <cstdio>
+
+static const int WARMUP = 20000;
+static const int SAMPLES = 200000;
+static const int RUNS = 5;
+
+static double run(Pete &pete, int samples, const std::vector<float> &noise)
+{
+	Module::ProcessArgs args;
+	args.sampleRate = 48000.f;
+	args.sampleTime = 1.f / 48000.f;
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < samples; ++i)
+	{
+		std::memcpy(pete.inputs[Pete::INPUT_INPUT].voltages, &noise[(i & 4095) * 16], 16 * sizeof(float));
+		pete.process(args);
+	}
+	const auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / samples;
+}
+
+static double best(Pete &pete, const std::vector<float> &noise)
+{
+	run(pete, WARMUP, noise);
+	double ns = run(pete, SAMPLES, noise);
+	for (int i = 1; i < RUNS; ++i)
+		ns = std::min(ns, run(pete, SAMPLES, noise));
+	return ns;
+}
+
+int main()
+{
+	std::vector<float> noise(4096 * 16);
+	for (auto &v : noise)
+		v = random::uniform() * 10.f - 5.f;
+
+	printf("%-16s %8s %8s %8s %8s %8s\n", "format", "channels", "off", "nearest", "linear", "hermite");
+	const char *format_names[PeteBuffer::NUM_FORMATS] = {"32-bit float", "16-bit integer"};
+	for (int format = 0; format < PeteBuffer::NUM_FORMATS; ++format)
+	{
+		for (int channels : {1, 4, 16})
+		{
+			Pete pete;
+			pete.storage_format = format;
+			pete.reallocate = true;
+			pete.stepBanks();
+			pete.params[Pete::BPM_PARAM].setValue(120.f);
+			pete.params[Pete::SPEED_PARAM].setValue(0.73f);
+			pete.inputs[Pete::INPUT_INPUT].setChannels(channels);
+			pete.outputs[Pete::OUTPUT_OUTPUT].setChannels(1);
+
+			double ns[Pete::NUM_INTERPOLATIONS + 1];
+			run(pete, 2 * 48000, noise);
+			ns[0] = best(pete, noise);
+
+			pete.params[Pete::ON_PARAM].setValue(1.f);
+			for (int interpolation = 0; interpolation < Pete::NUM_INTERPOLATIONS; ++interpolation)
+			{
+				pete.interpolation = interpolation;
+				ns[interpolation + 1] = best(pete, noise);
+			}
+
+			printf("%-16s %8d %8.1f %8.1f %8.1f %8.1f\n", format_names[format], channels, ns[0], ns[1], ns[2], ns[3]);
+		}
+	}
+	printf("ns per sample, best of %d runs of %d samples\n", RUNS, SAMPLES);
+	return 0;
+}
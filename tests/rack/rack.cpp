@@ -0,0 +1,304 @@
+#include <rack.hpp>
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+#include <random>
+
+namespace rack
+{
+static engine::Engine engine_instance;
+static Window window_instance;
+static Context context = {&window_instance, &engine_instance};
+
+Context *contextGet()
+{
+	return &context;
+}
+
+std::string string::f(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	char buffer[1024];
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	return buffer;
+}
+
+// seeded the same way every run, so the programs print the same numbers
+static std::mt19937_64 random_engine(1);
+
+float random::uniform()
+{
+	return (random_engine() >> 40) * (1.f / 16777216.f);
+}
+
+uint32_t random::u32()
+{
+	return static_cast<uint32_t>(random_engine());
+}
+
+uint64_t random::u64()
+{
+	return random_engine();
+}
+} // namespace rack
+
+NVGcolor nvgRGB(int r, int g, int b)
+{
+	NVGcolor color = {r / 255.f, g / 255.f, b / 255.f, 1.f};
+	return color;
+}
+void nvgFillColor(NVGcontext *, NVGcolor) {}
+void nvgStrokeColor(NVGcontext *, NVGcolor) {}
+void nvgBeginPath(NVGcontext *) {}
+void nvgRect(NVGcontext *, float, float, float, float) {}
+void nvgFill(NVGcontext *) {}
+void nvgStroke(NVGcontext *) {}
+void nvgStrokeWidth(NVGcontext *, float) {}
+void nvgRoundedRect(NVGcontext *, float, float, float, float, float) {}
+void nvgFontSize(NVGcontext *, float) {}
+float nvgText(NVGcontext *, float, float, const char *, const char *) { return 0.f; }
+
+enum
+{
+	JSON_OBJECT,
+	JSON_ARRAY,
+	JSON_INTEGER,
+	JSON_REAL,
+	JSON_STRING,
+	JSON_TRUE,
+	JSON_FALSE
+};
+
+struct json_t
+{
+	int type;
+	long long integer = 0;
+	double real = 0.0;
+	std::string string;
+	std::vector<std::pair<std::string, json_t *>> object;
+	std::vector<json_t *> array;
+
+	json_t(int type) : type(type) {}
+	~json_t()
+	{
+		for (auto &member : object)
+			delete member.second;
+		for (auto value : array)
+			delete value;
+	}
+};
+
+json_t *json_object() { return new json_t(JSON_OBJECT); }
+json_t *json_array() { return new json_t(JSON_ARRAY); }
+
+json_t *json_integer(long long value)
+{
+	json_t *json = new json_t(JSON_INTEGER);
+	json->integer = value;
+	return json;
+}
+
+json_t *json_real(double value)
+{
+	json_t *json = new json_t(JSON_REAL);
+	json->real = value;
+	return json;
+}
+
+json_t *json_string(const char *value)
+{
+	json_t *json = new json_t(JSON_STRING);
+	json->string = value;
+	return json;
+}
+
+json_t *json_boolean(bool value) { return new json_t(value ? JSON_TRUE : JSON_FALSE); }
+void json_decref(json_t *json) { delete json; }
+
+int json_object_set_new(json_t *object, const char *key, json_t *value)
+{
+	for (auto &member : object->object)
+	{
+		if (member.first == key)
+		{
+			delete member.second;
+			member.second = value;
+			return 0;
+		}
+	}
+	object->object.push_back(std::make_pair(std::string(key), value));
+	return 0;
+}
+
+json_t *json_object_get(const json_t *object, const char *key)
+{
+	if (!object || object->type != JSON_OBJECT)
+		return NULL;
+	for (auto &member : object->object)
+	{
+		if (member.first == key)
+			return member.second;
+	}
+	return NULL;
+}
+
+int json_array_append_new(json_t *array, json_t *value)
+{
+	array->array.push_back(value);
+	return 0;
+}
+
+size_t json_array_size(const json_t *array) { return array && array->type == JSON_ARRAY ? array->array.size() : 0; }
+json_t *json_array_get(const json_t *array, size_t index) { return index < json_array_size(array) ? array->array[index] : NULL; }
+
+long long json_integer_value(const json_t *json)
+{
+	if (!json)
+		return 0;
+	return json->type == JSON_REAL ? static_cast<long long>(json->real) : json->integer;
+}
+
+double json_real_value(const json_t *json) { return json && json->type == JSON_REAL ? json->real : 0.0; }
+double json_number_value(const json_t *json) { return json && json->type == JSON_INTEGER ? json->integer : json_real_value(json); }
+const char *json_string_value(const json_t *json) { return json && json->type == JSON_STRING ? json->string.c_str() : NULL; }
+size_t json_string_length(const json_t *json) { return json && json->type == JSON_STRING ? json->string.size() : 0; }
+bool json_is_true(const json_t *json) { return json && json->type == JSON_TRUE; }
+bool json_boolean_value(const json_t *json) { return json_is_true(json); }
+bool json_is_string(const json_t *json) { return json && json->type == JSON_STRING; }
+bool json_is_array(const json_t *json) { return json && json->type == JSON_ARRAY; }
+
+static void dumpString(std::string &out, const std::string &s)
+{
+	out += '"';
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	out += '"';
+}
+
+static void dump(std::string &out, const json_t *json)
+{
+	char number[64];
+	switch (json->type)
+	{
+	case JSON_OBJECT:
+		out += '{';
+		for (size_t i = 0; i < json->object.size(); ++i)
+		{
+			if (i > 0)
+				out += ',';
+			dumpString(out, json->object[i].first);
+			out += ':';
+			dump(out, json->object[i].second);
+		}
+		out += '}';
+		break;
+	case JSON_ARRAY:
+		out += '[';
+		for (size_t i = 0; i < json->array.size(); ++i)
+		{
+			if (i > 0)
+				out += ',';
+			dump(out, json->array[i]);
+		}
+		out += ']';
+		break;
+	case JSON_INTEGER:
+		snprintf(number, sizeof(number), "%lld", json->integer);
+		out += number;
+		break;
+	case JSON_REAL:
+		snprintf(number, sizeof(number), "%.17g", json->real);
+		out += number;
+		if (!strpbrk(number, ".eEn"))
+			out += ".0";
+		break;
+	case JSON_STRING:
+		dumpString(out, json->string);
+		break;
+	case JSON_TRUE:
+		out += "true";
+		break;
+	case JSON_FALSE:
+		out += "false";
+		break;
+	}
+}
+
+std::string json_dumps_string(const json_t *json)
+{
+	std::string out;
+	dump(out, json);
+	return out;
+}
+
+static json_t *load(const char *&p)
+{
+	while (*p == ' ' || *p == '\n' || *p == '\t')
+		++p;
+
+	if (*p == '{' || *p == '[')
+	{
+		const bool object = *p == '{';
+		json_t *json = object ? json_object() : json_array();
+		++p;
+		while (*p && *p != '}' && *p != ']')
+		{
+			if (object)
+			{
+				json_t *key = load(p);
+				++p; // ':'
+				json_object_set_new(json, key->string.c_str(), load(p));
+				delete key;
+			}
+			else
+			{
+				json_array_append_new(json, load(p));
+			}
+			if (*p == ',')
+				++p;
+		}
+		++p;
+		return json;
+	}
+
+	if (*p == '"')
+	{
+		json_t *json = new json_t(JSON_STRING);
+		for (++p; *p != '"'; ++p)
+		{
+			if (*p == '\\')
+				++p;
+			json->string += *p;
+		}
+		++p;
+		return json;
+	}
+
+	if (!strncmp(p, "true", 4) || !strncmp(p, "false", 5))
+	{
+		const bool value = *p == 't';
+		p += value ? 4 : 5;
+		return json_boolean(value);
+	}
+
+	const char *end = p;
+	while (*end && !strchr(",]}", *end))
+		++end;
+	const std::string number(p, end);
+	p = end;
+	if (number.find_first_of(".eEn") != std::string::npos)
+		return json_real(atof(number.c_str()));
+	return json_integer(atoll(number.c_str()));
+}
+
+json_t *json_loads_string(const std::string &text)
+{
+	const char *p = text.c_str();
+	return load(p);
+}
@@ -0,0 +1,652 @@
+// A headless stand-in for the parts of the Rack v1 API that the modules use, so the programs in tests/
+// can build and run a module's process() without the Rack SDK. it only covers what the modules call,
+// and only the behaviour they rely on. widgets, menus and drawing are empty, and json is a tiny
+// in-memory tree in rack.cpp
+#pragma once
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <emmintrin.h>
+#include <xmmintrin.h>
+
+typedef struct json_t json_t;
+json_t *json_object();
+json_t *json_array();
+json_t *json_integer(long long value);
+json_t *json_real(double value);
+json_t *json_string(const char *value);
+json_t *json_boolean(bool value);
+void json_decref(json_t *json);
+int json_object_set_new(json_t *object, const char *key, json_t *value);
+json_t *json_object_get(const json_t *object, const char *key);
+int json_array_append_new(json_t *array, json_t *value);
+size_t json_array_size(const json_t *array);
+json_t *json_array_get(const json_t *array, size_t index);
+long long json_integer_value(const json_t *json);
+double json_real_value(const json_t *json);
+double json_number_value(const json_t *json);
+const char *json_string_value(const json_t *json);
+size_t json_string_length(const json_t *json);
+bool json_is_true(const json_t *json);
+bool json_boolean_value(const json_t *json);
+bool json_is_string(const json_t *json);
+bool json_is_array(const json_t *json);
+// serializes to text and back, to measure and check what a patch file would hold
+std::string json_dumps_string(const json_t *json);
+json_t *json_loads_string(const std::string &text);
+#define json_array_foreach(array, index, value) for (index = 0; index < json_array_size(array) && (value = json_array_get(array, index)); index++)
+
+struct NVGcolor
+{
+	float r, g, b, a;
+};
+struct NVGcontext;
+NVGcolor nvgRGB(int r, int g, int b);
+void nvgFillColor(NVGcontext *, NVGcolor);
+void nvgStrokeColor(NVGcontext *, NVGcolor);
+void nvgBeginPath(NVGcontext *);
+void nvgRect(NVGcontext *, float, float, float, float);
+void nvgFill(NVGcontext *);
+void nvgStroke(NVGcontext *);
+void nvgStrokeWidth(NVGcontext *, float);
+void nvgRoundedRect(NVGcontext *, float, float, float, float, float);
+void nvgFontSize(NVGcontext *, float);
+float nvgText(NVGcontext *, float, float, const char *, const char *);
+
+#define GLFW_PRESS 1
+#define GLFW_RELEASE 0
+#define GLFW_MOD_SHIFT 1
+#define GLFW_MOD_CONTROL 2
+#define RACK_MOD_CTRL GLFW_MOD_CONTROL
+#define RACK_MOD_MASK 15
+#define CHECKMARK_STRING "\xe2\x9c\x94"
+#define CHECKMARK(_cond) ((_cond) ? CHECKMARK_STRING : "")
+#define RIGHT_ARROW "\xe2\x96\xb8"
+
+namespace rack
+{
+struct Svg;
+
+template <typename T>
+T clamp(T x, T a, T b) { return std::min(std::max(x, a), b); }
+inline float clamp(float x, float a, float b) { return std::min(std::max(x, a), b); }
+inline float rescale(float x, float a, float b, float y0, float y1) { return y0 + (x - a) / (b - a) * (y1 - y0); }
+inline float crossfade(float a, float b, float p) { return a + (b - a) * p; }
+inline int eucMod(int a, int b)
+{
+	int m = a % b;
+	if (m < 0)
+		m += b;
+	return m;
+}
+
+namespace math
+{
+using rack::clamp;
+using rack::crossfade;
+using rack::eucMod;
+using rack::rescale;
+struct Vec
+{
+	float x = 0, y = 0;
+	Vec() {}
+	Vec(float x, float y) : x(x), y(y) {}
+};
+struct Rect
+{
+	Vec pos, size;
+	Rect() {}
+	Rect(Vec pos, Vec size) : pos(pos), size(size) {}
+};
+inline bool isPow2(int n) { return n > 0 && (n & (n - 1)) == 0; }
+} // namespace math
+using math::Rect;
+using math::Vec;
+
+namespace string
+{
+std::string f(const char *format, ...);
+}
+namespace random
+{
+float uniform();
+uint32_t u32();
+uint64_t u64();
+} // namespace random
+
+namespace simd
+{
+template <typename T, int N>
+struct Vector;
+template <>
+struct Vector<int32_t, 4>;
+
+template <>
+struct Vector<float, 4>
+{
+	typedef float type;
+	constexpr static int size = 4;
+	union {
+		__m128 v;
+		float s[4];
+	};
+	Vector() = default;
+	Vector(__m128 v) : v(v) {}
+	Vector(float x) { v = _mm_set1_ps(x); }
+	Vector(float a, float b, float c, float d) { v = _mm_setr_ps(a, b, c, d); }
+	static Vector zero() { return Vector(_mm_setzero_ps()); }
+	static Vector mask() { return Vector(_mm_castsi128_ps(_mm_set1_epi32(-1))); }
+	static Vector load(const float *x) { return Vector(_mm_loadu_ps(x)); }
+	void store(float *x) { _mm_storeu_ps(x, v); }
+	float &operator[](int i) { return s[i]; }
+	const float &operator[](int i) const { return s[i]; }
+	Vector(Vector<int32_t, 4> a);
+	static Vector cast(Vector<int32_t, 4> a);
+};
+
+template <>
+struct Vector<int32_t, 4>
+{
+	typedef int32_t type;
+	constexpr static int size = 4;
+	union {
+		__m128i v;
+		int32_t s[4];
+	};
+	Vector() = default;
+	Vector(__m128i v) : v(v) {}
+	Vector(int32_t x) { v = _mm_set1_epi32(x); }
+	Vector(int32_t a, int32_t b, int32_t c, int32_t d) { v = _mm_setr_epi32(a, b, c, d); }
+	static Vector zero() { return Vector(_mm_setzero_si128()); }
+	static Vector load(const int32_t *x) { return Vector(_mm_loadu_si128((const __m128i *)x)); }
+	void store(int32_t *x) { _mm_storeu_si128((__m128i *)x, v); }
+	int32_t &operator[](int i) { return s[i]; }
+	const int32_t &operator[](int i) const { return s[i]; }
+	Vector(Vector<float, 4> a) { v = _mm_cvttps_epi32(a.v); }
+	static Vector cast(Vector<float, 4> a) { return Vector(_mm_castps_si128(a.v)); }
+};
+
+inline Vector<float, 4>::Vector(Vector<int32_t, 4> a) { v = _mm_cvtepi32_ps(a.v); }
+inline Vector<float, 4> Vector<float, 4>::cast(Vector<int32_t, 4> a) { return Vector(_mm_castsi128_ps(a.v)); }
+
+typedef Vector<float, 4> float_4;
+typedef Vector<int32_t, 4> int32_4;
+
+inline float_4 operator+(float_4 a, float_4 b) { return _mm_add_ps(a.v, b.v); }
+inline float_4 operator-(float_4 a, float_4 b) { return _mm_sub_ps(a.v, b.v); }
+inline float_4 operator*(float_4 a, float_4 b) { return _mm_mul_ps(a.v, b.v); }
+inline float_4 operator/(float_4 a, float_4 b) { return _mm_div_ps(a.v, b.v); }
+inline float_4 operator-(float_4 a) { return 0.f - a; }
+inline float_4 &operator+=(float_4 &a, float_4 b) { return a = a + b; }
+inline float_4 &operator-=(float_4 &a, float_4 b) { return a = a - b; }
+inline float_4 &operator*=(float_4 &a, float_4 b) { return a = a * b; }
+inline float_4 &operator/=(float_4 &a, float_4 b) { return a = a / b; }
+inline float_4 operator&(float_4 a, float_4 b) { return _mm_and_ps(a.v, b.v); }
+inline float_4 operator|(float_4 a, float_4 b) { return _mm_or_ps(a.v, b.v); }
+inline float_4 operator^(float_4 a, float_4 b) { return _mm_xor_ps(a.v, b.v); }
+inline float_4 operator~(float_4 a) { return a ^ float_4::mask(); }
+inline float_4 &operator&=(float_4 &a, float_4 b) { return a = a & b; }
+inline float_4 &operator|=(float_4 &a, float_4 b) { return a = a | b; }
+inline float_4 operator==(float_4 a, float_4 b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline float_4 operator!=(float_4 a, float_4 b) { return _mm_cmpneq_ps(a.v, b.v); }
+inline float_4 operator<(float_4 a, float_4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline float_4 operator<=(float_4 a, float_4 b) { return _mm_cmple_ps(a.v, b.v); }
+inline float_4 operator>(float_4 a, float_4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline float_4 operator>=(float_4 a, float_4 b) { return _mm_cmpge_ps(a.v, b.v); }
+
+inline int32_4 operator+(int32_4 a, int32_4 b) { return _mm_add_epi32(a.v, b.v); }
+inline int32_4 operator-(int32_4 a, int32_4 b) { return _mm_sub_epi32(a.v, b.v); }
+inline int32_4 operator&(int32_4 a, int32_4 b) { return _mm_and_si128(a.v, b.v); }
+inline int32_4 operator|(int32_4 a, int32_4 b) { return _mm_or_si128(a.v, b.v); }
+inline int32_4 operator^(int32_4 a, int32_4 b) { return _mm_xor_si128(a.v, b.v); }
+inline int32_4 operator<<(int32_4 a, int b) { return _mm_slli_epi32(a.v, b); }
+inline int32_4 operator>>(int32_4 a, int b) { return _mm_srai_epi32(a.v, b); }
+inline int32_4 operator==(int32_4 a, int32_4 b) { return _mm_cmpeq_epi32(a.v, b.v); }
+inline int32_4 operator!=(int32_4 a, int32_4 b) { return _mm_xor_si128(_mm_cmpeq_epi32(a.v, b.v), _mm_set1_epi32(-1)); }
+inline int32_4 &operator+=(int32_4 &a, int32_4 b) { return a = a + b; }
+
+inline float_4 ifelse(float_4 mask, float_4 a, float_4 b) { return (mask & a) | (~mask & b); }
+inline int movemask(float_4 a) { return _mm_movemask_ps(a.v); }
+inline float_4 fmax(float_4 a, float_4 b) { return _mm_max_ps(a.v, b.v); }
+inline float_4 fmin(float_4 a, float_4 b) { return _mm_min_ps(a.v, b.v); }
+inline float_4 clamp(float_4 x, float_4 a = 0.f, float_4 b = 1.f) { return fmin(fmax(x, a), b); }
+inline float_4 abs(float_4 a) { return a & float_4::cast(int32_4(0x7fffffff)); }
+inline float_4 floor(float_4 a)
+{
+	float_4 r;
+	for (int i = 0; i < 4; i++)
+		r.s[i] = std::floor(a.s[i]);
+	return r;
+}
+inline float_4 trunc(float_4 a)
+{
+	float_4 r;
+	for (int i = 0; i < 4; i++)
+		r.s[i] = std::trunc(a.s[i]);
+	return r;
+}
+inline float_4 fmod(float_4 a, float_4 b) { return a - floor(a / b) * b; }
+inline float_4 rescale(float_4 x, float_4 a, float_4 b, float_4 y0, float_4 y1) { return y0 + (x - a) / (b - a) * (y1 - y0); }
+inline float_4 crossfade(float_4 a, float_4 b, float_4 p) { return a + (b - a) * p; }
+using std::abs;
+using std::floor;
+using std::fmax;
+using std::fmin;
+} // namespace simd
+
+namespace dsp
+{
+template <typename T = float>
+struct TSchmittTrigger
+{
+	T state = T::mask();
+	void reset() { state = T::mask(); }
+	T process(T in)
+	{
+		T on = (in >= 1.f);
+		T off = (in <= 0.f);
+		T triggered = ~state & on;
+		state = on | (state & ~off);
+		return triggered;
+	}
+};
+
+template <>
+struct TSchmittTrigger<float>
+{
+	bool state = true;
+	void reset() { state = true; }
+	bool process(float in)
+	{
+		if (state)
+		{
+			if (in <= 0.f)
+				state = false;
+		}
+		else if (in >= 1.f)
+		{
+			state = true;
+			return true;
+		}
+		return false;
+	}
+	bool isHigh() { return state; }
+};
+typedef TSchmittTrigger<> SchmittTrigger;
+
+struct Timer
+{
+	float time = 0.f;
+	void reset() { time = 0.f; }
+	float process(float deltaTime) { return time += deltaTime; }
+};
+
+struct PulseGenerator
+{
+	float remaining = 0.f;
+	void reset() { remaining = 0.f; }
+	bool process(float deltaTime)
+	{
+		if (remaining > 0.f)
+		{
+			remaining -= deltaTime;
+			return true;
+		}
+		return false;
+	}
+	void trigger(float duration = 1e-3f) { remaining = std::max(remaining, duration); }
+};
+
+struct ClockDivider
+{
+	uint32_t clock = 0;
+	uint32_t division = 1;
+	void reset() { clock = 0; }
+	void setDivision(uint32_t d) { division = d; }
+	uint32_t getDivision() { return division; }
+	uint32_t getClock() { return clock; }
+	bool process()
+	{
+		if (++clock >= division)
+		{
+			clock = 0;
+			return true;
+		}
+		return false;
+	}
+};
+
+// single producer, single consumer
+template <typename T, size_t S>
+struct RingBuffer
+{
+	std::atomic<size_t> start{0};
+	std::atomic<size_t> end{0};
+	T data[S];
+	void push(T t)
+	{
+		data[end % S] = t;
+		end++;
+	}
+	T shift()
+	{
+		T t = data[start % S];
+		start++;
+		return t;
+	}
+	void clear() { start = end.load(); }
+	bool empty() const { return start == end; }
+	bool full() const { return end - start == S; }
+	size_t size() const { return end - start; }
+	size_t capacity() const { return S - size(); }
+};
+} // namespace dsp
+
+namespace engine
+{
+static const int PORT_MAX_CHANNELS = 16;
+
+struct Param
+{
+	float value = 0.f;
+	float getValue() { return value; }
+	void setValue(float v) { value = v; }
+};
+
+struct Port
+{
+	union {
+		float voltages[PORT_MAX_CHANNELS] = {};
+		float value;
+	};
+	uint8_t channels = 0;
+
+	void setVoltage(float voltage, int channel = 0) { voltages[channel] = voltage; }
+	float getVoltage(int channel = 0) { return voltages[channel]; }
+	float getPolyVoltage(int channel) { return isMonophonic() ? getVoltage(0) : getVoltage(channel); }
+	float getNormalVoltage(float normal, int channel = 0) { return isConnected() ? getVoltage(channel) : normal; }
+	float getNormalPolyVoltage(float normal, int channel) { return isConnected() ? getPolyVoltage(channel) : normal; }
+	float *getVoltages(int firstChannel = 0) { return &voltages[firstChannel]; }
+	template <typename T>
+	T getVoltageSimd(int firstChannel) { return T::load(&voltages[firstChannel]); }
+	template <typename T>
+	T getPolyVoltageSimd(int firstChannel) { return isMonophonic() ? T(getVoltage(0)) : getVoltageSimd<T>(firstChannel); }
+	template <typename T>
+	T getNormalVoltageSimd(T normal, int firstChannel) { return isConnected() ? getVoltageSimd<T>(firstChannel) : normal; }
+	template <typename T>
+	T getNormalPolyVoltageSimd(T normal, int firstChannel) { return isConnected() ? getPolyVoltageSimd<T>(firstChannel) : normal; }
+	template <typename T>
+	void setVoltageSimd(T voltage, int firstChannel) { voltage.store(&voltages[firstChannel]); }
+
+	// like Rack, channels above the count are zeroed when it drops
+	void setChannels(int c)
+	{
+		for (int i = c; i < channels; ++i)
+			voltages[i] = 0.f;
+		channels = c;
+	}
+	int getChannels() { return channels; }
+	bool isConnected() { return channels > 0; }
+	bool isMonophonic() { return channels == 1; }
+	bool isPolyphonic() { return channels > 1; }
+};
+struct Output : Port
+{
+};
+struct Input : Port
+{
+};
+
+struct Light
+{
+	float value = 0.f;
+	void setBrightness(float brightness) { value = brightness; }
+	float getBrightness() { return value; }
+	// slow fall, immediate rise, as in Rack v1
+	void setSmoothBrightness(float brightness, float deltaTime)
+	{
+		const float v = brightness > 0.f ? brightness : 0.f;
+		if (v < value)
+			value += (v - value) * 30.f * deltaTime;
+		else
+			value = v;
+	}
+};
+
+struct Module
+{
+	int id = -1;
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+
+	struct ProcessArgs
+	{
+		float sampleRate;
+		float sampleTime;
+	};
+
+	virtual ~Module() {}
+	void config(int numParams, int numInputs, int numOutputs, int numLights = 0)
+	{
+		params.resize(numParams);
+		inputs.resize(numInputs);
+		outputs.resize(numOutputs);
+		lights.resize(numLights);
+	}
+	template <class TParamQuantity = void>
+	void configParam(int paramId, float minValue, float maxValue, float defaultValue, std::string label = "", std::string unit = "", float displayBase = 0.f, float displayMultiplier = 1.f, float displayOffset = 0.f)
+	{
+		params[paramId].value = defaultValue;
+	}
+	virtual void process(const ProcessArgs &args) {}
+	virtual json_t *dataToJson() { return NULL; }
+	virtual void dataFromJson(json_t *rootJ) {}
+	virtual void onReset() {}
+	virtual void onRandomize() {}
+	virtual void onAdd() {}
+	virtual void onRemove() {}
+	virtual void onSampleRateChange() {}
+};
+
+struct Engine
+{
+	float sampleRate = 48000.f;
+	float getSampleRate() { return sampleRate; }
+	float getSampleTime() { return 1.f / sampleRate; }
+};
+} // namespace engine
+using namespace engine;
+
+namespace event
+{
+struct Button
+{
+	int action;
+	int button;
+	int mods;
+	Vec pos;
+	void consume(void *) {}
+};
+struct Action
+{
+};
+struct Hover
+{
+};
+} // namespace event
+
+namespace widget
+{
+struct Widget
+{
+	struct
+	{
+		Vec pos, size;
+	} box;
+	struct DrawArgs
+	{
+		NVGcontext *vg;
+	};
+	virtual ~Widget() {}
+	virtual void draw(const DrawArgs &args) {}
+	virtual void step() {}
+	virtual void onButton(const event::Button &e) {}
+	void addChild(Widget *child) { delete child; }
+};
+struct SvgWidget : Widget
+{
+	void setSvg(std::shared_ptr<Svg> svg) {}
+};
+} // namespace widget
+using namespace widget;
+
+namespace ui
+{
+struct MenuEntry : Widget
+{
+	std::string text;
+};
+struct MenuLabel : MenuEntry
+{
+};
+struct MenuSeparator : MenuEntry
+{
+};
+struct Menu : Widget
+{
+};
+struct MenuItem : MenuEntry
+{
+	std::string rightText;
+	bool disabled = false;
+	virtual void onAction(const event::Action &e) {}
+	virtual Menu *createChildMenu() { return NULL; }
+};
+} // namespace ui
+using namespace ui;
+
+namespace app
+{
+struct ParamWidget : Widget
+{
+};
+struct PortWidget : Widget
+{
+};
+struct SvgPort : PortWidget
+{
+	void setSvg(std::shared_ptr<Svg> svg) {}
+};
+struct SvgSwitch : ParamWidget
+{
+	bool momentary;
+	void addFrame(std::shared_ptr<Svg> svg) {}
+};
+struct SvgKnob : ParamWidget
+{
+	float minAngle, maxAngle;
+	void setSvg(std::shared_ptr<Svg> svg) {}
+};
+struct ModuleLightWidget : Widget
+{
+	void addBaseColor(NVGcolor color) {}
+};
+struct ModuleWidget : Widget
+{
+	Module *module = NULL;
+	void setModule(Module *m) { module = m; }
+	void setPanel(std::shared_ptr<Svg> svg) {}
+	void addParam(ParamWidget *param) { delete param; }
+	void addInput(PortWidget *input) { delete input; }
+	void addOutput(PortWidget *output) { delete output; }
+	virtual void appendContextMenu(Menu *menu) {}
+};
+} // namespace app
+using namespace app;
+
+typedef SvgSwitch SVGSwitch;
+struct Rogan : SvgKnob
+{
+};
+struct PJ301MPort : SvgPort
+{
+};
+struct GrayModuleLightWidget : ModuleLightWidget
+{
+};
+template <typename TBase>
+struct SmallLight : TBase
+{
+};
+template <typename TBase>
+struct MediumLight : TBase
+{
+};
+
+struct Window
+{
+	std::shared_ptr<Svg> loadSvg(const std::string &filename) { return NULL; }
+};
+struct Context
+{
+	Window *window;
+	engine::Engine *engine;
+};
+Context *contextGet();
+#define APP rack::contextGet()
+
+namespace plugin
+{
+struct Model;
+struct Plugin
+{
+	void addModel(Model *model) {}
+};
+} // namespace plugin
+using plugin::Model;
+using plugin::Plugin;
+
+namespace asset
+{
+inline std::string plugin(Plugin *plugin, const std::string &filename) { return filename; }
+} // namespace asset
+
+template <class TWidget>
+TWidget *createParamCentered(Vec pos, Module *module, int paramId) { return NULL; }
+template <class TWidget>
+TWidget *createInputCentered(Vec pos, Module *module, int inputId) { return NULL; }
+template <class TWidget>
+TWidget *createOutputCentered(Vec pos, Module *module, int outputId) { return NULL; }
+template <class TWidget>
+TWidget *createLightCentered(Vec pos, Module *module, int firstLightId) { return NULL; }
+template <class TMenuLabel = MenuLabel>
+TMenuLabel *createMenuLabel(std::string text)
+{
+	TMenuLabel *label = new TMenuLabel;
+	label->text = text;
+	return label;
+}
+template <class TMenuItem = MenuItem>
+TMenuItem *createMenuItem(std::string text, std::string rightText = "")
+{
+	TMenuItem *item = new TMenuItem;
+	item->text = text;
+	item->rightText = rightText;
+	return item;
+}
+inline Vec mm2px(Vec mm) { return Vec(mm.x * 75.f / 25.4f, mm.y * 75.f / 25.4f); }
+inline float mm2px(float mm) { return mm * 75.f / 25.4f; }
+template <class TModule, class TModuleWidget>
+Model *createModel(std::string slug) { return NULL; }
+} // namespace rack
+using namespace rack;
@@ -0,0 +1,142 @@
+// renick's patch format. the round trip checks that saving, loading and saving again gives back the same
+// patch, that loading twice replaces rather than adds to what was there, and that patches from before the
+// words were strings still load. the benchmark fills 16 voices with full 32768-symbol words, and times
+// saving, reading the patch in on the ui thread, and the audio thread taking it in on its next sample
+#include "../src/renick.cpp"
+#include <chrono>
+#include <cstdio>
+
+static const int RUNS = 5;
+
+static Module::ProcessArgs processArgs()
+{
+	Module::ProcessArgs args;
+	args.sampleRate = 48000.f;
+	args.sampleTime = 1.f / 48000.f;
+	return args;
+}
+
+static std::string save(Renick &renick)
+{
+	json_t *root_json = renick.dataToJson();
+	const std::string text = json_dumps_string(root_json);
+	json_decref(root_json);
+	return text;
+}
+
+// loads like Rack does and lets the engine run a sample, which is when the patch is taken in
+static void load(Renick &renick, const std::string &text)
+{
+	json_t *root_json = json_loads_string(text);
+	renick.dataFromJson(root_json);
+	json_decref(root_json);
+	renick.process(processArgs());
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok)
+		++failures;
+}
+
+static void roundTrip()
+{
+	Renick renick;
+	renick.setLarge(true);
+	renick.setVoices(3);
+	for (int v = 0; v < 3; ++v)
+	{
+		renick.edit_voice = v;
+		renick.selection = v;
+		renick.addLetter(v);
+		renick.addLetter(7 + v);
+		renick.selection = 7 + v;
+		renick.addLetter(15);
+		renick.addLetter(v);
+		renick.selection = 15;
+		renick.addLetter(0);
+	}
+	renick.params[Renick::TIME_PARAM].setValue(16.f);
+	for (int i = 0; i < 4; ++i)
+		renick.params[i].setValue(1.f);
+	for (int n = 0; n < 200000; ++n)
+		renick.process(processArgs());
+
+	const std::string saved = save(renick);
+	Renick copy;
+	load(copy, saved);
+	check(save(copy) == saved, "save, load and save again gives the same patch");
+
+	load(copy, saved);
+	load(copy, saved);
+	check(save(copy) == saved, "loading again replaces rather than adds");
+	check(copy.num_voices == 3 && copy.large && copy.word(1).size() == renick.word(1).size(), "voices, mode and words come back");
+
+	// a patch from before there were voices, with its word and rules as arrays of symbols
+	json_t *old_json = json_object();
+	json_t *word_json = json_array();
+	for (int s : {0, 1, 2, 3, 1})
+		json_array_append_new(word_json, json_integer(s));
+	json_object_set_new(old_json, "word", word_json);
+	json_t *rule_json = json_array();
+	json_array_append_new(rule_json, json_integer(1));
+	json_array_append_new(rule_json, json_integer(2));
+	json_object_set_new(old_json, "rule_0", rule_json);
+	json_object_set_new(old_json, "pos", json_integer(3));
+	Renick old;
+	load(old, json_dumps_string(old_json));
+	load(old, json_dumps_string(old_json));
+	json_decref(old_json);
+	check(renickToLetters(old.word(0)) == "abcdb" && renickToLetters(old.rules[0][0]) == "bc" && old.pos[0] == 3, "older patches with arrays of symbols load");
+}
+
+static void largeWords()
+{
+	Renick renick;
+	renick.setLarge(true);
+	renick.setVoices(Renick::MAX_VOICES);
+	renick.process(processArgs());
+	for (int v = 0; v < Renick::MAX_VOICES; ++v)
+	{
+		renick.word(v).clear();
+		for (int i = 0; i < Renick::LARGE_WORD_MAX; ++i)
+			renick.word(v).push_back(random::u32() % Renick::LARGE_SYMBOLS);
+	}
+
+	double save_ms = 1e9, read_ms = 1e9, apply_ms = 1e9;
+	std::string text;
+	Renick copy;
+	for (int run = 0; run < RUNS; ++run)
+	{
+		auto start = std::chrono::steady_clock::now();
+		text = save(renick);
+		auto end = std::chrono::steady_clock::now();
+		save_ms = std::min(save_ms, std::chrono::duration<double, std::milli>(end - start).count());
+
+		json_t *root_json = json_loads_string(text);
+		start = std::chrono::steady_clock::now();
+		copy.dataFromJson(root_json);
+		end = std::chrono::steady_clock::now();
+		json_decref(root_json);
+		read_ms = std::min(read_ms, std::chrono::duration<double, std::milli>(end - start).count());
+
+		start = std::chrono::steady_clock::now();
+		copy.process(processArgs());
+		end = std::chrono::steady_clock::now();
+		apply_ms = std::min(apply_ms, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+
+	printf("%d voices of %d symbols: %zu bytes of json\n", Renick::MAX_VOICES, Renick::LARGE_WORD_MAX, text.size());
+	printf("save %.2f ms, fromJson on the ui thread %.2f ms, taken in by the audio thread %.3f ms (best of %d)\n", save_ms, read_ms, apply_ms, RUNS);
+	check(save(copy).size() == text.size(), "the patch doesn't grow with each save and load");
+}
+
+int main()
+{
+	roundTrip();
+	largeWords();
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+// how closely timothy follows a clock patched into its clock input. the clock is a 1ms pulse per beat with
+// gaussian jitter on every edge, and each run reports the rms jitter of the edges going in and of timothy's
+// beats coming out, both against the ideal beat grid, once the follower has had time to lock.
+// the multiplier runs check that the beats stay on the grid when timothy is faster or slower than the clock.
+// the last runs change the tempo after the first stretch of beats, in one step or in a ramp over the whole
+// second stretch. lock is how many clock beats it then takes until the beats land within a millisecond of the grid
+#include "../src/timothy.cpp"
+#include <cstdio>
+#include <random>
+
+static const float SAMPLE_RATE = 48000.f;
+static const int SETTLE_BEATS = 64;
+static const int MEASURE_BEATS = 2000;
+
+struct Run
+{
+	const char *name;
+	float bpm;
+	double jitter;
+	int mul_param; // -1 for no multiplier
+	float mul;
+	float new_bpm; // tempo after the first stretch, 0 to keep it
+	bool ramp;	   // move to new_bpm gradually over the second stretch rather than all at once
+};
+
+struct Result
+{
+	double in_jitter = 0.0, out_jitter = 0.0;
+	int lock_beats = -1;
+};
+
+static double nearest(const std::vector<double> &grid, double t)
+{
+	auto i = std::lower_bound(grid.begin(), grid.end(), t);
+	if (i == grid.end())
+		return grid.back();
+	if (i != grid.begin() && t - *(i - 1) < *i - t)
+		--i;
+	return *i;
+}
+
+// rms distance of each time from the point on the grid nearest to it, once the average offset is taken out
+static double gridJitter(const std::vector<double> &times, const std::vector<double> &grid)
+{
+	std::vector<double> errors;
+	double sum = 0.0;
+	for (double t : times)
+	{
+		errors.push_back(t - nearest(grid, t));
+		sum += errors.back();
+	}
+	const double mean = sum / errors.size();
+	double squares = 0.0;
+	for (double e : errors)
+		squares += (e - mean) * (e - mean);
+	return std::sqrt(squares / errors.size());
+}
+
+static Result follow(const Run &run)
+{
+	Timothy timothy;
+	if (run.mul_param >= 0)
+		timothy.params[run.mul_param].setValue(1.f);
+	timothy.inputs[Timothy::CLOCK_INPUT].setChannels(1);
+	Module::ProcessArgs args;
+	args.sampleRate = SAMPLE_RATE;
+	args.sampleTime = 1.f / SAMPLE_RATE;
+
+	// ideal holds where every edge is due, and edges where it actually comes, give or take the jitter.
+	// the clock is one stretch of SETTLE_BEATS + MEASURE_BEATS edges, or two with the tempo change in between
+	const int length = SETTLE_BEATS + MEASURE_BEATS;
+	const int stretches = run.new_bpm > 0.f ? 2 : 1;
+	std::vector<double> ideal;
+	std::vector<long> edges;
+	std::mt19937 engine(7);
+	std::normal_distribution<double> noise(0.0, 1.0);
+	double t = 1000.0;
+	for (int k = 0; k < stretches * length; ++k)
+	{
+		float bpm = run.bpm;
+		if (k >= length)
+			bpm = run.ramp ? run.bpm + (run.new_bpm - run.bpm) * (k - length) / MEASURE_BEATS : run.new_bpm;
+		ideal.push_back(t);
+		edges.push_back(static_cast<long>(std::round(t + run.jitter * noise(engine))));
+		t += 60.0 * SAMPLE_RATE / bpm;
+	}
+
+	// timothy's beats should land on every edge, or in between them when it runs faster than the clock
+	std::vector<double> grid;
+	const int subdivisions = std::max(static_cast<int>(run.mul), 1);
+	for (size_t k = 0; k + 1 < ideal.size(); ++k)
+	{
+		for (int i = 0; i < subdivisions; ++i)
+			grid.push_back(ideal[k] + (ideal[k + 1] - ideal[k]) * i / subdivisions);
+	}
+	grid.push_back(ideal.back());
+	const double end = ideal.back() + (grid[grid.size() - 1] - grid[grid.size() - 2]) / 2;
+
+	// jitter is measured over the last MEASURE_BEATS - SETTLE_BEATS edges
+	const int first = (stretches - 1) * length + 2 * SETTLE_BEATS;
+	const double from = ideal[first], change = ideal[(stretches - 1) * length];
+	std::vector<double> in_times, out_times;
+	for (size_t k = first; k < edges.size(); ++k)
+		in_times.push_back(edges[k]);
+
+	Result result;
+	int in_line = 0;
+	size_t next_edge = 0;
+	for (long n = 0; n < end; ++n)
+	{
+		while (next_edge < edges.size() && edges[next_edge] + 48 <= n)
+			++next_edge;
+		const bool high = next_edge < edges.size() && n >= edges[next_edge];
+		timothy.inputs[Timothy::CLOCK_INPUT].setVoltage(high ? 10.f : 0.f);
+
+		const uint32_t beats = timothy.poly_beats;
+		timothy.process(args);
+		if (timothy.poly_beats == beats || n < change)
+			continue;
+
+		// locked from the first of 16 beats in a row within a millisecond of the grid
+		if (result.lock_beats < 0)
+		{
+			in_line = std::abs(n - nearest(grid, n)) < 1e-3 * SAMPLE_RATE ? in_line + 1 : 0;
+			if (in_line == 16)
+			{
+				const double locked = nearest(grid, n) - 15 * (grid[1] - grid[0]);
+				result.lock_beats = std::lower_bound(ideal.begin(), ideal.end(), locked) - ideal.begin() - (stretches - 1) * length;
+			}
+		}
+		if (n >= from - 100)
+			out_times.push_back(n);
+	}
+
+	result.in_jitter = gridJitter(in_times, ideal);
+	result.out_jitter = gridJitter(out_times, grid);
+	return result;
+}
+
+int main()
+{
+	const Run runs[] = {
+		{"steady", 120.f, 0.0, -1, 1.f, 0.f, false},
+		{"jitter 4", 120.f, 4.0, -1, 1.f, 0.f, false},
+		{"jitter 17", 120.f, 17.0, -1, 1.f, 0.f, false},
+		{"jitter 17", 137.f, 17.0, -1, 1.f, 0.f, false},
+		{"jitter 17", 600.f, 17.0, -1, 1.f, 0.f, false},
+		{"jitter 17 x2", 120.f, 17.0, Timothy::MUL_2_PARAM, 2.f, 0.f, false},
+		{"jitter 17 x4", 90.f, 17.0, Timothy::MUL_4_PARAM, 4.f, 0.f, false},
+		{"jitter 17 /2", 120.f, 17.0, Timothy::MUL_HALF_PARAM, 0.5f, 0.f, false},
+		{"jitter 17 /4", 160.f, 17.0, Timothy::MUL_QUARTER_PARAM, 0.25f, 0.f, false},
+		{"step to 130", 120.f, 17.0, -1, 1.f, 130.f, false},
+		{"step to 80", 120.f, 17.0, -1, 1.f, 80.f, false},
+		{"ramp to 130", 120.f, 17.0, -1, 1.f, 130.f, true},
+		{"ramp to 110", 120.f, 17.0, -1, 1.f, 110.f, true},
+	};
+
+	printf("%-14s %6s %6s %10s %10s %8s\n", "clock", "bpm", "to", "in rms", "out rms", "lock");
+	for (const Run &run : runs)
+	{
+		const Result result = follow(run);
+		printf("%-14s %6.0f %6.0f %10.2f %10.2f", run.name, run.bpm, run.new_bpm > 0.f ? run.new_bpm : run.bpm, result.in_jitter, result.out_jitter);
+		if (run.new_bpm > 0.f)
+			printf(" %8d", result.lock_beats);
+		printf("\n");
+	}
+	printf("jitter in samples at %.0f Hz, over the last %d beats of each run\n", SAMPLE_RATE, MEASURE_BEATS - SETTLE_BEATS);
+	return 0;
+}
@@ -0,0 +1,97 @@
+// long-run accuracy of timothy's clock. renders 24 hours (or the number of hours given as the first
+// argument) of the beat output at a few tempos and sample rates, and compares every beat with its ideal
+// time, k * 60 * sample rate / bpm samples after the start. drift is how far the last beat is from where it
+// should be, max error the worst beat of the run, and jitter the rms of each beat interval against the
+// ideal period. the float timer the clock used to run from is rendered alongside for comparison
+#include "../src/timothy.cpp"
+#include <cstdio>
+
+struct Stats
+{
+	long beats = 0;
+	double drift = 0.0, max_error = 0.0, jitter = 0.0;
+};
+
+struct Tracker
+{
+	double period;
+	Stats stats;
+	double sum_squares = 0.0;
+	long last_tick = 0;
+
+	Tracker(double period) : period(period) {}
+
+	void tick(long n)
+	{
+		++stats.beats;
+		const double error = n - stats.beats * period;
+		stats.drift = error;
+		stats.max_error = std::max(stats.max_error, std::abs(error));
+		const double interval = n - last_tick - period;
+		sum_squares += interval * interval;
+		last_tick = n;
+		stats.jitter = std::sqrt(sum_squares / stats.beats);
+	}
+};
+
+static Stats renderTimothy(float bpm, float sample_rate, long samples)
+{
+	Timothy timothy;
+	timothy.params[Timothy::BPM_PARAM].setValue(bpm);
+	Module::ProcessArgs args;
+	args.sampleRate = sample_rate;
+	args.sampleTime = 1.f / sample_rate;
+
+	Tracker tracker(60.0 * sample_rate / bpm);
+	for (long n = 1; n <= samples; ++n)
+	{
+		const uint32_t beats = timothy.poly_beats;
+		timothy.process(args);
+		if (timothy.poly_beats != beats)
+			tracker.tick(n);
+	}
+	return tracker.stats;
+}
+
+// what the clock did before, a dsp::Timer that adds up the sample time and resets on each beat
+static Stats renderFloatTimer(float bpm, float sample_rate, long samples)
+{
+	const float dur = 60.f / bpm, sample_time = 1.f / sample_rate;
+	Tracker tracker(60.0 * sample_rate / bpm);
+	float time = 0.f;
+	for (long n = 1; n <= samples; ++n)
+	{
+		time += sample_time;
+		if (time >= dur)
+		{
+			time = 0.f;
+			tracker.tick(n);
+		}
+	}
+	return tracker.stats;
+}
+
+static void print(const char *name, float bpm, float sample_rate, const Stats &stats)
+{
+	printf("%-12s %8.2f %8.0f %10ld %12.3f %12.3f %10.4f\n", name, bpm, sample_rate, stats.beats, stats.drift / sample_rate * 1e3, stats.max_error / sample_rate * 1e3, stats.jitter);
+}
+
+int main(int argc, char **argv)
+{
+	const double hours = argc > 1 ? atof(argv[1]) : 24.0;
+
+	struct
+	{
+		float bpm, sample_rate;
+	} runs[] = {{120.f, 48000.f}, {137.f, 44100.f}, {93.7f, 96000.f}};
+
+	printf("%-12s %8s %8s %10s %12s %12s %10s\n", "clock", "bpm", "rate", "beats", "drift ms", "max err ms", "jitter");
+	for (auto &run : runs)
+	{
+		const long samples = static_cast<long>(hours * 3600.0 * run.sample_rate);
+		print("phase", run.bpm, run.sample_rate, renderTimothy(run.bpm, run.sample_rate, samples));
+		print("float timer", run.bpm, run.sample_rate, renderFloatTimer(run.bpm, run.sample_rate, samples));
+	}
+	printf("over %.1f hours, jitter is the rms beat interval error in samples\n", hours);
+	return 0;
+}